@@ -0,0 +1,2519 @@
+// libwave.c — Embeddable terminal wave renderer
+// Palettes, column kernels, cell grid and ANSI frame encoder.
+//
+// Copyright (c) 2026. MIT License.
+
+#include "libwave.h"
+
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+// ════════════════════════════════════════════════════════════════════
+//  Constants
+// ════════════════════════════════════════════════════════════════════
+
+#define STARFIELD_DENSITY 600     // 1-in-N chance of a star per cell
+#define STARFIELD_GRAY_BASE 236   // base 256-color grayscale index
+#define STARFIELD_GRAY_RANGE 4    // number of gray shades available
+#define FOAM_LEVELS 3             // foam glyphs, faint to bright
+#define WAVE_COLOR_OFFSET 0.18    // per-wave color phase offset
+#define TWO_PI 6.2831853071795864
+
+#define DEFAULT_PALETTE "rainbow"
+#define DEFAULT_GENERATOR "shape"
+#define DEFAULT_TICK_RATE 60.0
+#define RNG_SEED 12345u
+
+// ════════════════════════════════════════════════════════════════════
+//  256-color palette functions
+// ════════════════════════════════════════════════════════════════════
+
+static inline int clamp6(int v) { return v < 0 ? 0 : (v > 5 ? 5 : v); }
+
+/// Map r,g,b [0-5] to 256-color cube index.
+static inline int cube(int r, int g, int b) {
+  return 16 + 36 * clamp6(r) + 6 * clamp6(g) + clamp6(b);
+}
+
+typedef int (*palette_fn)(double t);
+
+static int pal_rainbow(double t) {
+  int r = (int)(2.5 + 2.5 * sin(TWO_PI * t));
+  int g = (int)(2.5 + 2.5 * sin(TWO_PI * t + 2.094));
+  int b = (int)(2.5 + 2.5 * sin(TWO_PI * t + 4.189));
+  return cube(r, g, b);
+}
+
+static int pal_dracula(double t) {
+  int r = (int)(2.0 + 3.0 * sin(TWO_PI * t + 0.5));
+  int g = (int)(1.0 + 2.0 * sin(TWO_PI * t + 3.5));
+  int b = (int)(3.0 + 2.0 * sin(TWO_PI * t + 1.2));
+  return cube(r, g, b);
+}
+
+static int pal_ocean(double t) {
+  int r = (int)(0.5 + 1.5 * sin(TWO_PI * t + 4.0));
+  int g = (int)(2.0 + 2.5 * sin(TWO_PI * t + 1.0));
+  int b = (int)(3.5 + 1.5 * sin(TWO_PI * t));
+  return cube(r, g, b);
+}
+
+static int pal_fire(double t) {
+  int r = (int)(3.5 + 1.5 * sin(TWO_PI * t));
+  int g = (int)(1.5 + 2.0 * sin(TWO_PI * t + 0.8));
+  int b = (int)(0.5 + 0.5 * sin(TWO_PI * t + 1.6));
+  return cube(r, g, b);
+}
+
+static int pal_pastel(double t) {
+  int r = (int)(3.5 + 1.5 * sin(TWO_PI * t));
+  int g = (int)(3.0 + 1.5 * sin(TWO_PI * t + 2.094));
+  int b = (int)(3.5 + 1.5 * sin(TWO_PI * t + 4.189));
+  return cube(r, g, b);
+}
+
+static int pal_neon(double t) {
+  int r = (int)(2.5 + 2.5 * sin(TWO_PI * t));
+  int g = (int)(1.0 + 4.0 * sin(TWO_PI * t + 2.5));
+  int b = (int)(2.0 + 3.0 * sin(TWO_PI * t + 4.8));
+  return cube(r, g, b);
+}
+
+static int pal_aurora(double t) {
+  int r = (int)(1.0 + 2.0 * sin(TWO_PI * t + 3.8));
+  int g = (int)(3.0 + 2.0 * sin(TWO_PI * t));
+  int b = (int)(2.0 + 2.5 * sin(TWO_PI * t + 1.8));
+  return cube(r, g, b);
+}
+
+static int pal_matrix(double t) {
+  int g = (int)(1.5 + 3.5 * sin(TWO_PI * t));
+  return cube(0, g, 0);
+}
+
+static const struct {
+  const char *name;
+  palette_fn fn;
+} builtin_palettes[] = {
+    {"rainbow", pal_rainbow}, {"dracula", pal_dracula}, {"ocean", pal_ocean},
+    {"fire", pal_fire},       {"pastel", pal_pastel},   {"neon", pal_neon},
+    {"aurora", pal_aurora},   {"matrix", pal_matrix},
+};
+
+// ════════════════════════════════════════════════════════════════════
+//  Wave generation helpers
+// ════════════════════════════════════════════════════════════════════
+
+static const char *default_glyphs[] = {"█", "▓", "░", "●", "◆",
+                                       "╳", "◈", "▪", "⬡", "✦"};
+static const int NUM_DEFAULT_GLYPHS = 10;
+
+void wave_generate(Wave *waves, int n, const char *glyph_override) {
+  for (int i = 0; i < n; i++) {
+    double t = (double)i / (n > 1 ? (n - 1) : 1);
+    waves[i].freq = 0.06 + 0.10 * t;
+    waves[i].amp = 0.85 - 0.50 * t;
+    waves[i].phase_spd = 0.030 + 0.055 * t;
+    waves[i].glyph = glyph_override ? glyph_override
+                                    : default_glyphs[i % NUM_DEFAULT_GLYPHS];
+    waves[i].shape = WAVE_SHAPE_SINE;
+    waves[i].num_harmonics = 0;
+  }
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Column kernels
+// ════════════════════════════════════════════════════════════════════
+//
+// Plotting is split in two passes per wave: a kernel fills one value in
+// [-1, 1] per column, then wave_plot_column() rasterizes the whole array
+// into the cell grid. Sources other than the built-in sine only need to
+// produce the column array.
+
+void wave_column_sine(const Wave *wv, double phase, int cols, double *ys) {
+  for (int x = 0; x < cols; x++)
+    ys[x] = sin(wv->freq * x + phase);
+}
+
+static const char *shape_names[WAVE_NUM_SHAPES] = {
+    [WAVE_SHAPE_SINE] = "sine",   [WAVE_SHAPE_SQUARE] = "square",
+    [WAVE_SHAPE_TRIANGLE] = "triangle", [WAVE_SHAPE_SAW] = "saw",
+    [WAVE_SHAPE_NOISE] = "noise",
+};
+
+const char *wave_shape_name(int shape) {
+  return shape >= 0 && shape < WAVE_NUM_SHAPES ? shape_names[shape] : NULL;
+}
+
+int wave_find_shape(const char *name) {
+  for (int s = 0; s < WAVE_NUM_SHAPES; s++) {
+    if (strcasecmp(shape_names[s], name) == 0)
+      return s;
+  }
+  return -1;
+}
+
+/// Smooth 1D value noise in [-1, 1] with a lattice point every unit.
+static double value_noise(double q, uint32_t seed) {
+  double fl = floor(q);
+  double f = q - fl;
+  uint32_t i = (uint32_t)(int64_t)fl;
+  double v[2];
+  for (int k = 0; k < 2; k++) {
+    uint32_t h = (i + (uint32_t)k) * 0x9E3779B1u ^ seed;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    v[k] = (double)h * (2.0 / 4294967295.0) - 1.0;
+  }
+  f = f * f * (3.0 - 2.0 * f);
+  return v[0] + (v[1] - v[0]) * f;
+}
+
+// A sine with no overtones, which wave_column_sine() draws exactly.
+static bool plain_sine(const Wave *wv) {
+  return wv->shape == WAVE_SHAPE_SINE &&
+         (wv->num_harmonics == 0 ||
+          (wv->num_harmonics == 1 && wv->harmonics[0] > 0.0));
+}
+
+// Harmonics are accumulated one whole column pass at a time with the
+// shape switch outside the loop. Sine series use the Chebyshev
+// recurrence sin((k+1)θ) = 2cos θ sin kθ − sin((k−1)θ), so a column costs
+// one sin/cos pair however many harmonics the wave has.
+void wave_column_shape(const Wave *wv, double phase, int cols, double *ys) {
+  const int nh = wv->num_harmonics < WAVE_MAX_HARMONICS
+                     ? wv->num_harmonics
+                     : WAVE_MAX_HARMONICS;
+  if (plain_sine(wv)) {
+    wave_column_sine(wv, phase, cols, ys);
+    return;
+  }
+  const double one = 1.0;
+  const double *h = nh > 0 ? wv->harmonics : &one;
+  const int terms = nh > 0 ? nh : 1;
+  double norm = 0.0;
+  for (int k = 0; k < terms; k++)
+    norm += fabs(h[k]);
+  if (norm == 0.0) {
+    memset(ys, 0, (size_t)cols * sizeof(double));
+    return;
+  }
+  norm = 1.0 / norm;
+
+  if (wv->shape == WAVE_SHAPE_SINE) {
+    for (int x = 0; x < cols; x++) {
+      double th = wv->freq * x + phase;
+      double c2 = 2.0 * cos(th);
+      double s0 = 0.0, s1 = sin(th), acc = h[0] * s1;
+      for (int k = 1; k < terms; k++) {
+        double s2 = c2 * s1 - s0;
+        acc += h[k] * s2;
+        s0 = s1;
+        s1 = s2;
+      }
+      ys[x] = acc * norm;
+    }
+    return;
+  }
+
+  memset(ys, 0, (size_t)cols * sizeof(double));
+  const uint32_t seed = (uint32_t)(wv->freq * 1e6);
+  for (int k = 0; k < terms; k++) {
+    if (h[k] == 0.0)
+      continue;
+    // Position in cycles of harmonic k+1
+    const double m = (k + 1) / TWO_PI;
+    const double w = h[k] * norm;
+    switch (wv->shape) {
+    case WAVE_SHAPE_SQUARE:
+      for (int x = 0; x < cols; x++) {
+        double u = m * (wv->freq * x + phase);
+        ys[x] += u - floor(u) < 0.5 ? w : -w;
+      }
+      break;
+    case WAVE_SHAPE_TRIANGLE:
+      for (int x = 0; x < cols; x++) {
+        double v = m * (wv->freq * x + phase) + 0.25;
+        ys[x] += w * (1.0 - 4.0 * fabs(v - floor(v) - 0.5));
+      }
+      break;
+    case WAVE_SHAPE_SAW:
+      for (int x = 0; x < cols; x++) {
+        double v = m * (wv->freq * x + phase) + 0.5;
+        ys[x] += w * (2.0 * (v - floor(v)) - 1.0);
+      }
+      break;
+    default: // noise: two lattice points per cycle, like a sine's extrema
+      for (int x = 0; x < cols; x++)
+        ys[x] += w * value_noise(2.0 * m * (wv->freq * x + phase), seed + k);
+      break;
+    }
+  }
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Simplex noise
+// ════════════════════════════════════════════════════════════════════
+//
+// 2D simplex noise evaluated NOISE_LANES columns at a time with GCC
+// vector extensions sized for a 128-bit register (SSE2 / NEON). Every
+// step is branch-free: floors by integer conversion and compare, lattice
+// hashing with integer multiply/xor, gradient selection and the corner
+// falloff as mask arithmetic.
+//
+// Lanes run in single precision. To keep that exact as drift grows, the
+// block is first translated in double precision by a whole lattice cell
+// (I, J); simplex noise is invariant under such shifts as long as the
+// hash still sees the absolute cell, so only small offsets reach floats.
+
+#define NOISE_LANES 4
+#define NOISE_F2 0.36602540378443864676 // (sqrt(3) - 1) / 2
+#define NOISE_G2 0.21132486540518711775 // (3 - sqrt(3)) / 6
+#define NOISE_SCALE 0.5    // lattice units per radian of wave phase
+#define NOISE_EVOLVE 0.35  // how fast the field changes vs. scrolls
+#define NOISE_ROW_GAP 7.31 // lattice rows between waves and octaves
+#define NOISE_GAIN 40.0f   // brings the sum of corners to about [-1, 1]
+
+typedef float NoiseVf __attribute__((vector_size(NOISE_LANES * 4)));
+typedef int32_t NoiseVi __attribute__((vector_size(NOISE_LANES * 4)));
+typedef uint32_t NoiseVu __attribute__((vector_size(NOISE_LANES * 4)));
+
+/// Simplex noise at (px[l], py) for every lane.
+static void simplex_lanes(const double *px, double py, double *out) {
+  // Lattice cell of the first lane, and the block relative to it
+  const double s0 = (px[0] + py) * NOISE_F2;
+  const double ci = floor(px[0] + s0), cj = floor(py + s0);
+  const double ct = (ci + cj) * NOISE_G2;
+  const NoiseVi base_i = (NoiseVi){0} + (int32_t)(int64_t)ci;
+  const NoiseVi base_j = (NoiseVi){0} + (int32_t)(int64_t)cj;
+  NoiseVf x, y = (NoiseVf){0} + (float)(py - (cj - ct));
+  for (int l = 0; l < NOISE_LANES; l++)
+    x[l] = (float)(px[l] - (ci - ct));
+
+  // Skew to find the containing simplex cell (floor via truncation)
+  NoiseVf s = (x + y) * (float)NOISE_F2;
+  NoiseVf xs = x + s, ys = y + s;
+  NoiseVi i = __builtin_convertvector(xs, NoiseVi);
+  NoiseVi j = __builtin_convertvector(ys, NoiseVi);
+  i += xs < __builtin_convertvector(i, NoiseVf); // compare yields -1 / 0
+  j += ys < __builtin_convertvector(j, NoiseVf);
+  NoiseVf t = __builtin_convertvector(i + j, NoiseVf) * (float)NOISE_G2;
+  NoiseVf cx[3], cy[3];
+  cx[0] = x - (__builtin_convertvector(i, NoiseVf) - t);
+  cy[0] = y - (__builtin_convertvector(j, NoiseVf) - t);
+
+  // Middle corner: +x first in the lower triangle, +y first otherwise
+  NoiseVi i1 = -(cx[0] > cy[0]);
+  NoiseVf i1f = __builtin_convertvector(i1, NoiseVf);
+  cx[1] = cx[0] - i1f + (float)NOISE_G2;
+  cy[1] = cy[0] - (1.0f - i1f) + (float)NOISE_G2;
+  cx[2] = cx[0] - 1.0f + 2.0f * (float)NOISE_G2;
+  cy[2] = cy[0] - 1.0f + 2.0f * (float)NOISE_G2;
+  i += base_i;
+  j += base_j;
+  NoiseVi hi[3] = {i, i + i1, i + 1};
+  NoiseVi hj[3] = {j, j + (1 - i1), j + 1};
+
+  NoiseVf sum = {0};
+  for (int k = 0; k < 3; k++) {
+    NoiseVu h = (NoiseVu)hi[k] * 0x9E3779B1u ^ (NoiseVu)hj[k] * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 13;
+    // Hash bits pick one of eight gradients
+    NoiseVf swap = __builtin_convertvector((NoiseVi)((h >> 2) & 1), NoiseVf);
+    NoiseVf sx = 1.0f - 2.0f * __builtin_convertvector((NoiseVi)(h & 1),
+                                                       NoiseVf);
+    NoiseVf sy = 2.0f - 4.0f * __builtin_convertvector(
+                                   (NoiseVi)((h >> 1) & 1), NoiseVf);
+    NoiseVf u = cx[k] + (cy[k] - cx[k]) * swap;
+    NoiseVf v = cy[k] + (cx[k] - cy[k]) * swap;
+    NoiseVf f = 0.5f - cx[k] * cx[k] - cy[k] * cy[k];
+    // Clamp at zero; the tiny floor keeps f^4 out of slow denormals
+    f = (NoiseVf)((NoiseVi)f & (f > 1e-6f));
+    f *= f;
+    sum += f * f * (u * sx + v * sy);
+  }
+  for (int l = 0; l < NOISE_LANES; l++)
+    out[l] = NOISE_GAIN * sum[l];
+}
+
+void wave_column_simplex(const Wave *wv, int w, double drift, int octaves,
+                         int cols, double *ys) {
+  double px[NOISE_LANES], val[NOISE_LANES];
+  if (octaves < 1)
+    octaves = 1;
+  // fBm: each octave doubles the frequency and halves the weight. The
+  // octaves are uncorrelated, so normalizing by their RMS weight keeps
+  // the spread of a single octave; rare peaks past 1 are clipped.
+  double norm = 0.0;
+  for (int o = 0; o < octaves; o++)
+    norm += ldexp(1.0, -2 * o);
+  norm = sqrt(norm);
+
+  for (int x0 = 0; x0 < cols; x0 += NOISE_LANES) {
+    double acc[NOISE_LANES] = {0};
+    double scale = NOISE_SCALE, weight = 1.0 / norm;
+    for (int o = 0; o < octaves; o++) {
+      for (int l = 0; l < NOISE_LANES; l++)
+        px[l] = scale * (wv->freq * (x0 + l) + drift);
+      double py = scale * drift * NOISE_EVOLVE + (w + o) * NOISE_ROW_GAP;
+      simplex_lanes(px, py, val);
+      for (int l = 0; l < NOISE_LANES; l++)
+        acc[l] += weight * val[l];
+      scale *= 2.0;
+      weight *= 0.5;
+    }
+    const int n = cols - x0 < NOISE_LANES ? cols - x0 : NOISE_LANES;
+    for (int l = 0; l < n; l++)
+      ys[x0 + l] = fmax(-1.0, fmin(1.0, acc[l]));
+  }
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Superposition
+// ════════════════════════════════════════════════════════════════════
+//
+// Interference sums every wave's displacement, weighted by amplitude,
+// into one column array. Waves of random phase add up to about the
+// square root of their summed power, so the sum is normalized by
+// sqrt(2 * sum of amp^2): two equal waves in phase just reach 1, and the
+// pattern keeps its height from two waves to a thousand.
+//
+// For plain sines the sum never calls sin() per column. Each wave keeps
+// SUM_LANES consecutive columns as rotating (sin, cos) pairs and turns
+// the whole group by SUM_LANES * freq per step, so the work per wave and
+// column is a multiply-add on fixed-size lane arrays that the compiler
+// keeps in vector registers.
+
+#define SUM_LANES 8
+
+void wave_superpose_add(double *acc, const double *ys, double amp, int cols) {
+  for (int x = 0; x < cols; x++)
+    acc[x] += amp * ys[x];
+}
+
+void wave_superpose_norm(double *acc, double power, int cols) {
+  const double norm = power > 0.0 ? 1.0 / sqrt(2.0 * power) : 0.0;
+  for (int x = 0; x < cols; x++)
+    acc[x] = fmax(-1.0, fmin(1.0, acc[x] * norm));
+}
+
+// Add amp * sin(freq * x + phase) over the columns to ys.
+static void add_sine(double *ys, double amp, double freq, double phase,
+                     int cols) {
+  double s[SUM_LANES], c[SUM_LANES];
+  for (int l = 0; l < SUM_LANES; l++) {
+    s[l] = amp * sin(freq * l + phase);
+    c[l] = amp * cos(freq * l + phase);
+  }
+  const double rs = sin(freq * SUM_LANES), rc = cos(freq * SUM_LANES);
+  int x0 = 0;
+  for (; x0 + SUM_LANES <= cols; x0 += SUM_LANES) {
+    for (int l = 0; l < SUM_LANES; l++) {
+      ys[x0 + l] += s[l];
+      const double t = s[l] * rc + c[l] * rs;
+      c[l] = c[l] * rc - s[l] * rs;
+      s[l] = t;
+    }
+  }
+  for (int l = 0; x0 + l < cols; l++)
+    ys[x0 + l] += s[l];
+}
+
+void wave_superpose(const Wave *waves, const double *phase, int n, int cols,
+                    double *ys) {
+  double power = 0.0;
+  memset(ys, 0, (size_t)cols * sizeof(double));
+  for (int w = 0; w < n; w++) {
+    power += waves[w].amp * waves[w].amp;
+    add_sine(ys, waves[w].amp, waves[w].freq, phase[w], cols);
+  }
+  wave_superpose_norm(ys, power, cols);
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Wave equation
+// ════════════════════════════════════════════════════════════════════
+//
+// Physics mode simulates a damped string, u_tt = c^2 u_xx - gamma u_t,
+// one height per column with both ends held at zero. The leapfrog
+// scheme needs only the current and previous heights, and writes the
+// next step over the previous one, so a step is a single pass over two
+// arrays. The interior runs in fixed SUM_LANES groups so the stencil
+// vectorizes.
+//
+// The context steps the string at a fixed PHYS_DT of simulation time,
+// as many sub-steps as the frame interval needs, independent of the
+// render rate. The buffers grow only in wave_ctx_begin() when the frame
+// widens; stepping and impulses never allocate.
+
+#define PHYS_DT (1.0 / 240.0) // simulation step, seconds
+#define PHYS_SPEED 120.0      // wave speed, columns per second
+#define PHYS_DAMPING 0.8      // velocity damping per second
+#define PHYS_MAX_STEPS 32     // sub-steps per frame; the rest is dropped
+#define PHYS_DROP_WIDTH 2.0   // impulse radius (Gaussian sigma), columns
+
+void wave_string_step(const double *restrict h, double *restrict prev,
+                      int cols, double r2, double keep) {
+  int x = 1;
+  for (; x + SUM_LANES < cols; x += SUM_LANES) {
+    for (int l = 0; l < SUM_LANES; l++) {
+      const int i = x + l;
+      prev[i] = h[i] + keep * (h[i] - prev[i]) +
+                r2 * (h[i - 1] - 2.0 * h[i] + h[i + 1]);
+    }
+  }
+  for (; x < cols - 1; x++)
+    prev[x] = h[x] + keep * (h[x] - prev[x]) +
+              r2 * (h[x - 1] - 2.0 * h[x] + h[x + 1]);
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Palette & generator registry
+// ════════════════════════════════════════════════════════════════════
+//
+// Palettes are stored as lookup tables sampled once at registration, so
+// the encoder does one table read per cell whichever palette (built-in
+// or plugin) is active. Built-ins are registered on first use.
+
+typedef struct {
+  const char *name;
+  unsigned char lut[WAVE_LUT_SIZE];
+} PaletteEntry;
+
+static PaletteEntry g_palettes[WAVE_MAX_PALETTES];
+static int g_num_palettes;
+static WaveGeneratorDef g_generators[WAVE_MAX_GENERATORS];
+static int g_num_generators;
+
+static void registry_init(void);
+
+static int palette_index(const char *name) {
+  registry_init();
+  for (int i = 0; i < g_num_palettes; i++) {
+    if (strcasecmp(g_palettes[i].name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+static int generator_index(const char *name) {
+  registry_init();
+  for (int i = 0; i < g_num_generators; i++) {
+    if (strcasecmp(g_generators[i].name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+/// Claim a palette slot for `name`. NULL if taken or full.
+static PaletteEntry *palette_slot(const char *name) {
+  if (!name || palette_index(name) >= 0 ||
+      g_num_palettes >= WAVE_MAX_PALETTES)
+    return NULL;
+  PaletteEntry *pe = &g_palettes[g_num_palettes++];
+  pe->name = name;
+  return pe;
+}
+
+bool wave_register_palette(const WavePaletteDef *def) {
+  if (!def->build_lut)
+    return false;
+  PaletteEntry *pe = palette_slot(def->name);
+  if (!pe)
+    return false;
+  def->build_lut(pe->lut, WAVE_LUT_SIZE);
+  return true;
+}
+
+bool wave_register_generator(const WaveGeneratorDef *def) {
+  if (!def->name || !def->columns || generator_index(def->name) >= 0 ||
+      g_num_generators >= WAVE_MAX_GENERATORS)
+    return false;
+  g_generators[g_num_generators++] = *def;
+  return true;
+}
+
+static void registry_init(void) {
+  static bool done = false;
+  if (done)
+    return;
+  done = true;
+  const int n = (int)(sizeof(builtin_palettes) / sizeof(builtin_palettes[0]));
+  for (int i = 0; i < n; i++) {
+    PaletteEntry *pe = palette_slot(builtin_palettes[i].name);
+    for (int k = 0; k < WAVE_LUT_SIZE; k++)
+      pe->lut[k] =
+          (unsigned char)builtin_palettes[i].fn((double)k / WAVE_LUT_SIZE);
+  }
+  wave_register_generator(&(WaveGeneratorDef){"shape", wave_column_shape});
+  wave_register_generator(&(WaveGeneratorDef){"sine", wave_column_sine});
+}
+
+const WaveRegistry *wave_registry(void) {
+  static const WaveRegistry reg = {
+      .abi_version = WAVE_PLUGIN_ABI,
+      .add_palette = wave_register_palette,
+      .add_generator = wave_register_generator,
+  };
+  registry_init();
+  return &reg;
+}
+
+int wave_palette_count(void) {
+  registry_init();
+  return g_num_palettes;
+}
+
+const char *wave_palette_name(int i) {
+  return i >= 0 && i < wave_palette_count() ? g_palettes[i].name : NULL;
+}
+
+int wave_generator_count(void) {
+  registry_init();
+  return g_num_generators;
+}
+
+const char *wave_generator_name(int i) {
+  return i >= 0 && i < wave_generator_count() ? g_generators[i].name : NULL;
+}
+
+const unsigned char *wave_find_palette(const char *name) {
+  int i = palette_index(name);
+  return i >= 0 ? g_palettes[i].lut : NULL;
+}
+
+wave_columns_fn wave_find_generator(const char *name) {
+  int i = generator_index(name);
+  return i >= 0 ? g_generators[i].columns : NULL;
+}
+
+void wave_grid_clear(WaveGrid *g) {
+  memset(g->owner, 0xFF, (size_t)g->rows * (size_t)g->cols * sizeof(int));
+}
+
+void wave_plot_column(WaveGrid *g, int w, const double *ys, int mid_y,
+                      double scale, double color_base) {
+  const int rows = g->rows, cols = g->cols;
+  for (int x = 0; x < cols; x++) {
+    if (isnan(ys[x]))
+      continue;
+    int y = mid_y + (int)(scale * ys[x]);
+    if (y >= 0 && y < rows) {
+      size_t idx = (size_t)y * (size_t)cols + (size_t)x;
+      g->owner[idx] = w;
+      g->val[idx] = (double)x / cols + color_base;
+    }
+  }
+}
+
+void wave_plot_span(WaveGrid *g, int w, const double *lo, const double *hi,
+                    int mid_y, double scale, double color_base) {
+  const int rows = g->rows, cols = g->cols;
+  for (int x = 0; x < cols; x++) {
+    if (isnan(lo[x]) || isnan(hi[x]))
+      continue;
+    int y0 = mid_y + (int)(scale * lo[x]);
+    int y1 = mid_y + (int)(scale * hi[x]);
+    if (y0 > y1) {
+      int tmp = y0;
+      y0 = y1;
+      y1 = tmp;
+    }
+    if (y0 < 0)
+      y0 = 0;
+    if (y1 > rows - 1)
+      y1 = rows - 1;
+    double val = (double)x / cols + color_base;
+    for (int y = y0; y <= y1; y++) {
+      size_t idx = (size_t)y * (size_t)cols + (size_t)x;
+      g->owner[idx] = w;
+      g->val[idx] = val;
+    }
+  }
+}
+
+void wave_plot_intensity(WaveGrid *g, int w, const double *ys,
+                         double color_base) {
+  const int rows = g->rows, cols = g->cols;
+  for (int x = 0; x < cols; x++) {
+    if (isnan(ys[x]))
+      continue;
+    // Bars grow from the bottom row, shading up the palette with height
+    const int h = (int)(ys[x] * ys[x] * rows + 0.5);
+    for (int k = 0; k < h; k++) {
+      size_t idx = (size_t)(rows - 1 - k) * (size_t)cols + (size_t)x;
+      g->owner[idx] = w;
+      g->val[idx] = color_base + 0.5 * k / rows;
+    }
+  }
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Formula VM
+// ════════════════════════════════════════════════════════════════════
+//
+// A recursive-descent parser emits stack-machine bytecode, folding
+// constant subexpressions as it goes. The VM runs each instruction over
+// a block of WAVE_FORMULA_BLOCK columns, so dispatch costs one switch per
+// instruction per block rather than per column, and the inner loops are
+// plain array arithmetic the compiler can vectorize.
+
+enum {
+  FOP_X,     // push column indices
+  FOP_CONST, // push k
+  FOP_VAR,   // push vars[arg]
+  FOP_ADD,
+  FOP_SUB,
+  FOP_MUL,
+  FOP_DIV,
+  FOP_MOD,
+  FOP_POW,
+  FOP_MIN,
+  FOP_MAX,
+  FOP_NEG,
+  FOP_SIN,
+  FOP_COS,
+  FOP_TAN,
+  FOP_TANH,
+  FOP_ABS,
+  FOP_SQRT,
+  FOP_EXP,
+  FOP_LOG,
+  FOP_FLOOR,
+};
+
+enum { FVAR_T, FVAR_I, FVAR_N, FVAR_F, FVAR_P, FVAR_COUNT };
+
+static const struct {
+  const char *name;
+  int var;
+} formula_vars[] = {
+    {"t", FVAR_T}, {"i", FVAR_I}, {"n", FVAR_N}, {"f", FVAR_F}, {"p", FVAR_P},
+};
+
+static const struct {
+  const char *name;
+  int args;
+  unsigned char op;
+} formula_funcs[] = {
+    {"sin", 1, FOP_SIN},   {"cos", 1, FOP_COS},   {"tan", 1, FOP_TAN},
+    {"tanh", 1, FOP_TANH}, {"abs", 1, FOP_ABS},   {"sqrt", 1, FOP_SQRT},
+    {"exp", 1, FOP_EXP},   {"log", 1, FOP_LOG},   {"floor", 1, FOP_FLOOR},
+    {"min", 2, FOP_MIN},   {"max", 2, FOP_MAX},
+};
+
+#define FORMULA_MAX_NESTING 64 // parser recursion, bounds the C stack used
+
+typedef struct {
+  const char *src;
+  const char *p;
+  WaveFormula *f;
+  int depth;     // stack depth after the code emitted so far
+  int nesting;   // recursion depth of the parser itself
+  char *err;
+  size_t errcap;
+  bool failed;
+} FormulaParser;
+
+/// Record the first error with the 1-based column it occurred at.
+static void fp_error(FormulaParser *fp, const char *msg) {
+  if (fp->failed)
+    return;
+  fp->failed = true;
+  if (fp->errcap)
+    snprintf(fp->err, fp->errcap, "%s at column %d", msg,
+             (int)(fp->p - fp->src) + 1);
+}
+
+static void fp_skip(FormulaParser *fp) {
+  while (*fp->p == ' ' || *fp->p == '\t')
+    fp->p++;
+}
+
+static bool fp_accept(FormulaParser *fp, char ch) {
+  fp_skip(fp);
+  if (*fp->p != ch)
+    return false;
+  fp->p++;
+  return true;
+}
+
+/// Scalar version of an operator, for constant folding.
+static double fold_op(unsigned char op, double a, double b) {
+  switch (op) {
+  case FOP_ADD:
+    return a + b;
+  case FOP_SUB:
+    return a - b;
+  case FOP_MUL:
+    return a * b;
+  case FOP_DIV:
+    return a / b;
+  case FOP_MOD:
+    return fmod(a, b);
+  case FOP_POW:
+    return pow(a, b);
+  case FOP_MIN:
+    return fmin(a, b);
+  case FOP_MAX:
+    return fmax(a, b);
+  case FOP_NEG:
+    return -a;
+  case FOP_SIN:
+    return sin(a);
+  case FOP_COS:
+    return cos(a);
+  case FOP_TAN:
+    return tan(a);
+  case FOP_TANH:
+    return tanh(a);
+  case FOP_ABS:
+    return fabs(a);
+  case FOP_SQRT:
+    return sqrt(a);
+  case FOP_EXP:
+    return exp(a);
+  case FOP_LOG:
+    return log(a);
+  default:
+    return floor(a);
+  }
+}
+
+static void fp_emit(FormulaParser *fp, unsigned char op, unsigned char arg,
+                    double k) {
+  WaveFormula *f = fp->f;
+  if (op == FOP_X || op == FOP_CONST || op == FOP_VAR) {
+    if (++fp->depth > WAVE_FORMULA_MAX_STACK)
+      fp_error(fp, "expression nested too deeply");
+  } else if (op >= FOP_ADD && op <= FOP_MAX) {
+    fp->depth--;
+    // Both operands constant: replace them with the result
+    if (f->len >= 2 && f->code[f->len - 1].op == FOP_CONST &&
+        f->code[f->len - 2].op == FOP_CONST) {
+      f->len--;
+      f->code[f->len - 1].k =
+          fold_op(op, f->code[f->len - 1].k, f->code[f->len].k);
+      return;
+    }
+  } else if (f->len >= 1 && f->code[f->len - 1].op == FOP_CONST) {
+    f->code[f->len - 1].k = fold_op(op, f->code[f->len - 1].k, 0.0);
+    return;
+  }
+  if (f->len >= WAVE_FORMULA_MAX_CODE) {
+    fp_error(fp, "expression too long");
+    return;
+  }
+  f->code[f->len++] = (WaveFormulaIns){op, arg, k};
+}
+
+static void fp_expr(FormulaParser *fp);
+static void fp_unary(FormulaParser *fp);
+
+/// Descend one level; fails once the input nests too deeply, so hostile
+/// text cannot run the parser off the end of the stack.
+static bool fp_enter(FormulaParser *fp) {
+  if (++fp->nesting <= FORMULA_MAX_NESTING)
+    return true;
+  fp_error(fp, "expression nested too deeply");
+  return false;
+}
+
+static void fp_primary(FormulaParser *fp) {
+  fp_skip(fp);
+  const char *p = fp->p;
+  if ((*p >= '0' && *p <= '9') || *p == '.') {
+    char *end;
+    double k = strtod(p, &end);
+    fp->p = end;
+    fp_emit(fp, FOP_CONST, 0, k);
+    return;
+  }
+  if (fp_accept(fp, '(')) {
+    if (fp_enter(fp))
+      fp_expr(fp);
+    fp->nesting--;
+    if (!fp_accept(fp, ')'))
+      fp_error(fp, "expected ')'");
+    return;
+  }
+
+  size_t len = 0;
+  while ((p[len] >= 'a' && p[len] <= 'z') || (p[len] >= 'A' && p[len] <= 'Z'))
+    len++;
+  if (len == 0) {
+    fp_error(fp, *p ? "unexpected character" : "unexpected end");
+    return;
+  }
+  fp->p += len;
+  if (len == 1 && (*p == 'x' || *p == 'X')) {
+    fp_emit(fp, FOP_X, 0, 0.0);
+    return;
+  }
+  if (len == 2 && strncasecmp(p, "pi", 2) == 0) {
+    fp_emit(fp, FOP_CONST, 0, TWO_PI / 2.0);
+    return;
+  }
+  for (size_t v = 0; v < sizeof(formula_vars) / sizeof(formula_vars[0]); v++) {
+    if (len == 1 && strncasecmp(p, formula_vars[v].name, 1) == 0) {
+      fp_emit(fp, FOP_VAR, (unsigned char)formula_vars[v].var, 0.0);
+      return;
+    }
+  }
+  for (size_t i = 0; i < sizeof(formula_funcs) / sizeof(formula_funcs[0]);
+       i++) {
+    if (strlen(formula_funcs[i].name) != len ||
+        strncasecmp(p, formula_funcs[i].name, len) != 0)
+      continue;
+    if (!fp_accept(fp, '(')) {
+      fp_error(fp, "expected '('");
+      return;
+    }
+    bool deeper = fp_enter(fp);
+    for (int a = 0; deeper && a < formula_funcs[i].args; a++) {
+      if (a > 0 && !fp_accept(fp, ',')) {
+        fp_error(fp, "expected ','");
+        break;
+      }
+      fp_expr(fp);
+    }
+    fp->nesting--;
+    if (fp->failed)
+      return;
+    if (!fp_accept(fp, ')')) {
+      fp_error(fp, "expected ')'");
+      return;
+    }
+    fp_emit(fp, formula_funcs[i].op, 0, 0.0);
+    return;
+  }
+  fp->p = p;
+  fp_error(fp, "unknown name");
+}
+
+static void fp_power(FormulaParser *fp) {
+  fp_primary(fp);
+  if (fp_accept(fp, '^')) {
+    fp_unary(fp); // right-associative, binds tighter than unary minus
+    fp_emit(fp, FOP_POW, 0, 0.0);
+  }
+}
+
+static void fp_unary(FormulaParser *fp) {
+  // Every cycle of the grammar (parentheses, calls, '^', unary minus)
+  // passes through here
+  if (!fp_enter(fp)) {
+    fp->nesting--;
+    return;
+  }
+  if (fp_accept(fp, '-')) {
+    fp_unary(fp);
+    fp_emit(fp, FOP_NEG, 0, 0.0);
+  } else {
+    fp_accept(fp, '+');
+    fp_power(fp);
+  }
+  fp->nesting--;
+}
+
+static void fp_term(FormulaParser *fp) {
+  fp_unary(fp);
+  while (!fp->failed) {
+    unsigned char op;
+    if (fp_accept(fp, '*'))
+      op = FOP_MUL;
+    else if (fp_accept(fp, '/'))
+      op = FOP_DIV;
+    else if (fp_accept(fp, '%'))
+      op = FOP_MOD;
+    else
+      break;
+    fp_unary(fp);
+    fp_emit(fp, op, 0, 0.0);
+  }
+}
+
+static void fp_expr(FormulaParser *fp) {
+  fp_term(fp);
+  while (!fp->failed) {
+    unsigned char op;
+    if (fp_accept(fp, '+'))
+      op = FOP_ADD;
+    else if (fp_accept(fp, '-'))
+      op = FOP_SUB;
+    else
+      break;
+    fp_term(fp);
+    fp_emit(fp, op, 0, 0.0);
+  }
+}
+
+bool wave_formula_compile(WaveFormula *out, const char *src, char *err,
+                          size_t errcap) {
+  FormulaParser fp = {src, src, out, 0, 0, err, errcap, false};
+  out->len = 0;
+  fp_expr(&fp);
+  fp_skip(&fp);
+  if (*fp.p)
+    fp_error(&fp, "unexpected character");
+  return !fp.failed;
+}
+
+// Element-wise loops over one block: `a` is the destination and left
+// operand, `b` the right operand
+#define FORMULA_UNARY(expr)                                                  \
+  for (int k = 0; k < n; k++)                                                \
+    a[k] = expr;                                                             \
+  break
+#define FORMULA_BINARY(expr)                                                 \
+  sp--;                                                                      \
+  a = reg[sp - 1];                                                           \
+  b = reg[sp];                                                               \
+  for (int k = 0; k < n; k++)                                                \
+    a[k] = expr;                                                             \
+  break
+
+void wave_formula_eval(const WaveFormula *f, const WaveFormulaVars *v,
+                       int cols, double *ys) {
+  const double vars[FVAR_COUNT] = {
+      [FVAR_T] = v->t, [FVAR_I] = v->i,     [FVAR_N] = v->n,
+      [FVAR_F] = v->freq, [FVAR_P] = v->phase,
+  };
+  double reg[WAVE_FORMULA_MAX_STACK][WAVE_FORMULA_BLOCK];
+
+  for (int x0 = 0; x0 < cols; x0 += WAVE_FORMULA_BLOCK) {
+    const int n =
+        cols - x0 < WAVE_FORMULA_BLOCK ? cols - x0 : WAVE_FORMULA_BLOCK;
+    int sp = 0;
+    for (int pc = 0; pc < f->len; pc++) {
+      const WaveFormulaIns *in = &f->code[pc];
+      double *a = reg[sp > 0 ? sp - 1 : 0]; // top of stack
+      const double *b;
+      switch (in->op) {
+      case FOP_X:
+        a = reg[sp++];
+        FORMULA_UNARY((double)(x0 + k));
+      case FOP_CONST:
+        a = reg[sp++];
+        FORMULA_UNARY(in->k);
+      case FOP_VAR:
+        a = reg[sp++];
+        FORMULA_UNARY(vars[in->arg]);
+      case FOP_ADD:
+        FORMULA_BINARY(a[k] + b[k]);
+      case FOP_SUB:
+        FORMULA_BINARY(a[k] - b[k]);
+      case FOP_MUL:
+        FORMULA_BINARY(a[k] * b[k]);
+      case FOP_DIV:
+        FORMULA_BINARY(a[k] / b[k]);
+      case FOP_MOD:
+        FORMULA_BINARY(fmod(a[k], b[k]));
+      case FOP_POW:
+        FORMULA_BINARY(pow(a[k], b[k]));
+      case FOP_MIN:
+        FORMULA_BINARY(fmin(a[k], b[k]));
+      case FOP_MAX:
+        FORMULA_BINARY(fmax(a[k], b[k]));
+      case FOP_NEG:
+        FORMULA_UNARY(-a[k]);
+      case FOP_SIN:
+        FORMULA_UNARY(sin(a[k]));
+      case FOP_COS:
+        FORMULA_UNARY(cos(a[k]));
+      case FOP_TAN:
+        FORMULA_UNARY(tan(a[k]));
+      case FOP_TANH:
+        FORMULA_UNARY(tanh(a[k]));
+      case FOP_ABS:
+        FORMULA_UNARY(fabs(a[k]));
+      case FOP_SQRT:
+        FORMULA_UNARY(sqrt(a[k]));
+      case FOP_EXP:
+        FORMULA_UNARY(exp(a[k]));
+      case FOP_LOG:
+        FORMULA_UNARY(log(a[k]));
+      case FOP_FLOOR:
+        FORMULA_UNARY(floor(a[k]));
+      }
+    }
+    memcpy(ys + x0, reg[0], (size_t)n * sizeof(double));
+  }
+}
+
+#undef FORMULA_UNARY
+#undef FORMULA_BINARY
+
+// ════════════════════════════════════════════════════════════════════
+//  Frame encoding
+// ════════════════════════════════════════════════════════════════════
+
+size_t wave_frame_capacity(int rows, int cols) {
+  return (size_t)rows * (size_t)cols * WAVE_MAX_BYTES_PER_CELL +
+         WAVE_FRAME_PADDING;
+}
+
+// Foam levels 1..FOAM_LEVELS, drawn over everything else
+static const char *const foam_glyphs[FOAM_LEVELS] = {"·", "∘", "°"};
+static const unsigned char foam_glyph_len[FOAM_LEVELS] = {2, 3, 2};
+static const unsigned char foam_colors[FOAM_LEVELS] = {244, 250, 255};
+
+// Glyphs come from the context's id table when glyph_id is set, or
+// straight from the waves otherwise. `foam` holds a foam level per cell,
+// or is NULL.
+static size_t encode_grid(const WaveGrid *g, const Wave *waves,
+                          const unsigned char *glyph_id,
+                          const char *const *glyphs,
+                          const unsigned char *glyph_len,
+                          const unsigned char *foam,
+                          const unsigned char *lut, unsigned int *rng,
+                          int origin_row, char *buf, size_t cap) {
+  const int rows = g->rows, cols = g->cols;
+  size_t pos = 0;
+  for (int r = 0; r < rows; r++) {
+    if (origin_row) {
+      int written =
+          snprintf(buf + pos, cap - pos, "\033[%d;1H", origin_row + r);
+      if (written > 0)
+        pos += (size_t)written;
+    }
+    for (int c = 0; c < cols; c++) {
+      // Safety: ensure we never overflow the buffer
+      if (pos + WAVE_MAX_BYTES_PER_CELL >= cap)
+        return pos;
+
+      size_t idx = (size_t)r * (size_t)cols + (size_t)c;
+      if (foam && foam[idx]) {
+        const int level = foam[idx] - 1;
+        int written = snprintf(buf + pos, cap - pos, "\033[38;5;%dm",
+                               foam_colors[level]);
+        if (written > 0)
+          pos += (size_t)written;
+        memcpy(buf + pos, foam_glyphs[level], foam_glyph_len[level]);
+        pos += foam_glyph_len[level];
+        memcpy(buf + pos, "\033[0m", 4);
+        pos += 4;
+      } else if (g->owner[idx] >= 0) {
+        int w = g->owner[idx];
+        double t = fmod(g->val[idx] + w * WAVE_COLOR_OFFSET, 1.0);
+        if (t < 0.0)
+          t += 1.0;
+        int color = lut[(int)(t * WAVE_LUT_SIZE) & (WAVE_LUT_SIZE - 1)];
+
+        // Write fg color escape via snprintf for safety
+        int written =
+            snprintf(buf + pos, cap - pos, "\033[38;5;%dm", color);
+        if (written > 0)
+          pos += (size_t)written;
+
+        // Write glyph
+        const char *gl;
+        size_t gl_len;
+        if (glyph_id) {
+          gl = glyphs[glyph_id[w]];
+          gl_len = glyph_len[glyph_id[w]];
+        } else {
+          gl = waves[w].glyph;
+          gl_len = strlen(gl);
+        }
+        if (pos + gl_len + 4 < cap) {
+          memcpy(buf + pos, gl, gl_len);
+          pos += gl_len;
+        }
+
+        // Reset attributes
+        if (pos + 4 < cap) {
+          memcpy(buf + pos, "\033[0m", 4);
+          pos += 4;
+        }
+      } else {
+        // Subtle starfield background — fast xorshift RNG
+        *rng ^= *rng << 13;
+        *rng ^= *rng >> 17;
+        *rng ^= *rng << 5;
+
+        if ((*rng % STARFIELD_DENSITY) == 0) {
+          int gray = STARFIELD_GRAY_BASE +
+                     (int)((*rng >> 8) % STARFIELD_GRAY_RANGE);
+          int written = snprintf(buf + pos, cap - pos,
+                                 "\033[38;5;%dm.\033[0m", gray);
+          if (written > 0)
+            pos += (size_t)written;
+        } else {
+          buf[pos++] = ' ';
+        }
+      }
+    }
+    if (r < rows - 1 && !origin_row) {
+      buf[pos++] = '\n';
+    }
+  }
+  return pos;
+}
+
+// Encode rows x cols cells as "▀", each showing sample row 2r of
+// `color` in front and row 2r + 1 behind. Colors are only re-sent when
+// they change along a row.
+static size_t encode_halfblocks(const unsigned char *color, int rows,
+                                int cols, int origin_row, char *buf,
+                                size_t cap) {
+  size_t pos = 0;
+  for (int r = 0; r < rows; r++) {
+    if (origin_row) {
+      int written =
+          snprintf(buf + pos, cap - pos, "\033[%d;1H", origin_row + r);
+      if (written > 0)
+        pos += (size_t)written;
+    }
+    const unsigned char *top = color + (size_t)(2 * r) * (size_t)cols;
+    const unsigned char *bot = top + cols;
+    int fg = -1, bg = -1;
+    for (int c = 0; c < cols; c++) {
+      if (pos + WAVE_MAX_BYTES_PER_CELL >= cap)
+        return pos;
+      if (top[c] != fg || bot[c] != bg) {
+        fg = top[c];
+        bg = bot[c];
+        int written = snprintf(buf + pos, cap - pos,
+                               "\033[38;5;%d;48;5;%dm", fg, bg);
+        if (written > 0)
+          pos += (size_t)written;
+      }
+      memcpy(buf + pos, "\xe2\x96\x80", 3); // ▀
+      pos += 3;
+    }
+    memcpy(buf + pos, "\033[0m", 4);
+    pos += 4;
+    if (r < rows - 1 && !origin_row)
+      buf[pos++] = '\n';
+  }
+  return pos;
+}
+
+size_t wave_encode(const WaveGrid *g, const Wave *waves,
+                   const unsigned char *lut, unsigned int *rng,
+                   int origin_row, char *buf, size_t cap) {
+  return encode_grid(g, waves, NULL, NULL, NULL, NULL, lut, rng, origin_row,
+                     buf, cap);
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Worker pool
+// ════════════════════════════════════════════════════════════════════
+//
+// The full-screen simulations split each pass into tiles and hand them
+// out through an atomic counter, to a fixed set of workers and to the
+// calling thread alike, so a slow tile never holds a whole share of the
+// frame. pool_run() returns once every tile is done, which is the only
+// ordering between passes. Workers sleep on a condition variable
+// between passes and are started once, with the context. A pass only
+// takes as many workers as it has tiles to spare beyond the caller's,
+// so a small frame on a many-core host does not wake and wait for
+// workers that would find nothing left to do.
+
+#define POOL_MAX_WORKERS 63 // threads besides the caller
+
+typedef void (*pool_tile_fn)(void *arg, int tile);
+
+typedef struct {
+  pthread_t workers[POOL_MAX_WORKERS];
+  int num_workers;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;   // a pass was posted, or quit
+  pthread_cond_t idle;   // the last worker left the pass
+  unsigned long job_seq; // bumped per pass
+  int openings;          // workers the current pass may still take
+  int busy;              // workers still in the current pass
+  bool quit;
+  pool_tile_fn fn;
+  void *arg;
+  int tiles;
+  atomic_int next_tile;
+} WorkerPool;
+
+// Work tiles of the posted pass until none are left.
+static void pool_run_tiles(WorkerPool *p) {
+  for (int t; (t = atomic_fetch_add(&p->next_tile, 1)) < p->tiles;)
+    p->fn(p->arg, t);
+}
+
+static void *pool_worker(void *arg) {
+  WorkerPool *p = arg;
+  unsigned long seen = 0;
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (!p->quit && (p->job_seq == seen || !p->openings))
+      pthread_cond_wait(&p->wake, &p->lock);
+    if (p->quit)
+      break;
+    seen = p->job_seq;
+    p->openings--;
+    pthread_mutex_unlock(&p->lock);
+    pool_run_tiles(p);
+    pthread_mutex_lock(&p->lock);
+    if (--p->busy == 0)
+      pthread_cond_signal(&p->idle);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+// Run fn(arg, tile) for tiles 0..tiles-1 on the pool and the calling
+// thread, and return once every tile is done.
+static void pool_run(WorkerPool *p, pool_tile_fn fn, void *arg, int tiles) {
+  p->fn = fn;
+  p->arg = arg;
+  p->tiles = tiles;
+  atomic_store(&p->next_tile, 0);
+  // The caller works tiles too, so one tile needs no worker at all
+  const int helpers = tiles - 1 < p->num_workers ? tiles - 1 : p->num_workers;
+  if (helpers > 0) {
+    pthread_mutex_lock(&p->lock);
+    p->busy = p->openings = helpers;
+    p->job_seq++;
+    if (helpers == p->num_workers)
+      pthread_cond_broadcast(&p->wake);
+    else
+      for (int i = 0; i < helpers; i++)
+        pthread_cond_signal(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+  }
+  pool_run_tiles(p);
+  if (helpers > 0) {
+    pthread_mutex_lock(&p->lock);
+    while (p->busy)
+      pthread_cond_wait(&p->idle, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+  }
+}
+
+static void pool_free(WorkerPool *p) {
+  if (!p)
+    return;
+  pthread_mutex_lock(&p->lock);
+  p->quit = true;
+  pthread_cond_broadcast(&p->wake);
+  pthread_mutex_unlock(&p->lock);
+  for (int i = 0; i < p->num_workers; i++)
+    pthread_join(p->workers[i], NULL);
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->wake);
+  pthread_cond_destroy(&p->idle);
+  free(p);
+}
+
+// `threads` counts the caller; 0 = one per online CPU. A worker that
+// cannot be started just leaves more tiles to the others.
+static WorkerPool *pool_new(int threads) {
+  WorkerPool *p = calloc(1, sizeof(*p));
+  if (!p)
+    return NULL;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->wake, NULL);
+  pthread_cond_init(&p->idle, NULL);
+  atomic_init(&p->next_tile, 0);
+  if (threads <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (int)cpus : 1;
+  }
+  if (threads - 1 > POOL_MAX_WORKERS)
+    threads = POOL_MAX_WORKERS + 1;
+  for (int i = 0; i < threads - 1; i++) {
+    if (pthread_create(&p->workers[p->num_workers], NULL, pool_worker, p) ==
+        0)
+      p->num_workers++;
+  }
+  return p;
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Ripple tank
+// ════════════════════════════════════════════════════════════════════
+//
+// Ripple mode runs the damped 2D wave equation on a heightfield of two
+// samples per cell, one for each half of a "▀", and encodes every cell
+// as that glyph with the upper sample's color in front and the lower
+// one's behind. Samples are then roughly square on a terminal.
+//
+// Stepping and shading run on the worker pool in RIPPLE_TILE_ROWS x
+// RIPPLE_TILE_COLS tiles, small enough that a tile's rows of both height
+// arrays stay in L2. A leapfrog step reads the current heights and
+// overwrites the previous ones in place, so the tiles of one step never
+// conflict, and the pool's barrier between passes orders the steps.
+// Like the string, the tank is stepped at a fixed RIPPLE_DT and never
+// allocates outside a resize.
+
+#define RIPPLE_DT (1.0 / 240.0) // simulation step, seconds
+#define RIPPLE_SPEED 50.0       // wave speed, samples per second
+#define RIPPLE_DAMPING 0.5      // velocity damping per second
+#define RIPPLE_MAX_STEPS 16     // sub-steps per frame; the rest is dropped
+#define RIPPLE_DROP_RADIUS 1.5  // impulse radius (Gaussian sigma), samples
+#define RIPPLE_TILE_ROWS 32
+#define RIPPLE_TILE_COLS 512
+#define RIPPLE_SHADE 0.8       // palette span per unit of shaded height
+#define RIPPLE_LIGHT 1.5       // weight of the slope in the shading
+
+typedef struct {
+  int rows, cols;        // samples: two rows per cell
+  size_t cap;            // samples allocated
+  float *h;              // heights now
+  float *prev;           // and one step earlier
+  unsigned char *color;  // shaded palette index per sample
+  const unsigned char *lut;
+  double lag;            // simulation time not yet stepped
+  unsigned int rng;
+} Ripple;
+
+// One leapfrog step of samples [x0, x1) of a row; `h` and `prev` point at
+// the row, whose neighbors sit `w` samples before and after.
+static void ripple_step_row(const float *restrict h, float *restrict prev,
+                            ptrdiff_t w, int x0, int x1, float r2,
+                            float keep) {
+  int x = x0;
+  for (; x + SUM_LANES <= x1; x += SUM_LANES) {
+    for (int l = 0; l < SUM_LANES; l++) {
+      const int i = x + l;
+      prev[i] = h[i] + keep * (h[i] - prev[i]) +
+                r2 * (h[i - 1] + h[i + 1] + h[i - w] + h[i + w] -
+                      4.0f * h[i]);
+    }
+  }
+  for (; x < x1; x++)
+    prev[x] = h[x] + keep * (h[x] - prev[x]) +
+              r2 * (h[x - 1] + h[x + 1] + h[x - w] + h[x + w] - 4.0f * h[x]);
+}
+
+// One leapfrog step over the interior of rows [y0, y1) x cols [x0, x1).
+static void ripple_step_tile(Ripple *rp, int y0, int y1, int x0, int x1) {
+  const float courant = (float)(RIPPLE_SPEED * RIPPLE_DT);
+  const float keep = (float)(1.0 - RIPPLE_DAMPING * RIPPLE_DT);
+  if (y0 < 1)
+    y0 = 1;
+  if (y1 > rp->rows - 1)
+    y1 = rp->rows - 1;
+  if (x0 < 1)
+    x0 = 1;
+  if (x1 > rp->cols - 1)
+    x1 = rp->cols - 1;
+  for (int y = y0; y < y1; y++) {
+    const size_t base = (size_t)y * (size_t)rp->cols;
+    ripple_step_row(rp->h + base, rp->prev + base, rp->cols, x0, x1,
+                    courant * courant, keep);
+  }
+}
+
+// Color samples by height, lit from the left by the horizontal slope.
+// Calm water sits a quarter into the palette; crests and troughs span
+// its first half.
+static void ripple_shade_tile(Ripple *rp, int y0, int y1, int x0, int x1) {
+  const int w = rp->cols;
+  for (int y = y0; y < y1; y++) {
+    const float *row = rp->h + (size_t)y * (size_t)w;
+    unsigned char *out = rp->color + (size_t)y * (size_t)w;
+    for (int x = x0; x < x1; x++) {
+      const float left = x > 0 ? row[x - 1] : 0.0f;
+      const float right = x < w - 1 ? row[x + 1] : 0.0f;
+      float v = (float)RIPPLE_SHADE *
+                (row[x] + (float)RIPPLE_LIGHT * (right - left));
+      v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+      const int i = (int)((0.25f + 0.249f * v) * WAVE_LUT_SIZE);
+      out[x] = rp->lut[i];
+    }
+  }
+}
+
+// Bounds of tile t, row-major over the tank.
+static void ripple_tile(const Ripple *rp, int t, int *y0, int *y1, int *x0,
+                        int *x1) {
+  const int tiles_x = (rp->cols + RIPPLE_TILE_COLS - 1) / RIPPLE_TILE_COLS;
+  *y0 = t / tiles_x * RIPPLE_TILE_ROWS;
+  *x0 = t % tiles_x * RIPPLE_TILE_COLS;
+  *y1 = *y0 + RIPPLE_TILE_ROWS < rp->rows ? *y0 + RIPPLE_TILE_ROWS : rp->rows;
+  *x1 = *x0 + RIPPLE_TILE_COLS < rp->cols ? *x0 + RIPPLE_TILE_COLS : rp->cols;
+}
+
+static int ripple_tiles(const Ripple *rp) {
+  return (rp->cols + RIPPLE_TILE_COLS - 1) / RIPPLE_TILE_COLS *
+         ((rp->rows + RIPPLE_TILE_ROWS - 1) / RIPPLE_TILE_ROWS);
+}
+
+static void ripple_step_job(void *arg, int t) {
+  int y0, y1, x0, x1;
+  ripple_tile(arg, t, &y0, &y1, &x0, &x1);
+  ripple_step_tile(arg, y0, y1, x0, x1);
+}
+
+static void ripple_shade_job(void *arg, int t) {
+  int y0, y1, x0, x1;
+  ripple_tile(arg, t, &y0, &y1, &x0, &x1);
+  ripple_shade_tile(arg, y0, y1, x0, x1);
+}
+
+static void ripple_free(Ripple *rp) {
+  if (!rp)
+    return;
+  free(rp->h);
+  free(rp->prev);
+  free(rp->color);
+  free(rp);
+}
+
+static Ripple *ripple_new(const unsigned char *lut) {
+  Ripple *rp = calloc(1, sizeof(*rp));
+  if (!rp)
+    return NULL;
+  rp->lut = lut;
+  rp->rng = RNG_SEED ^ 0x85EBCA6Bu;
+  return rp;
+}
+
+// Size the tank for a rows x cols frame. A new size starts calm.
+static bool ripple_resize(Ripple *rp, int rows, int cols) {
+  if (rows * 2 == rp->rows && cols == rp->cols)
+    return true;
+  const size_t n = (size_t)rows * 2 * (size_t)cols;
+  if (n > rp->cap) {
+    float *h = realloc(rp->h, n * sizeof(float));
+    if (!h)
+      return false;
+    rp->h = h;
+    float *prev = realloc(rp->prev, n * sizeof(float));
+    if (!prev)
+      return false;
+    rp->prev = prev;
+    unsigned char *color = realloc(rp->color, n);
+    if (!color)
+      return false;
+    rp->color = color;
+    rp->cap = n;
+  }
+  rp->rows = rows * 2;
+  rp->cols = cols;
+  memset(rp->h, 0, n * sizeof(float));
+  memset(rp->prev, 0, n * sizeof(float));
+  return true;
+}
+
+static double ripple_random(Ripple *rp) {
+  rp->rng ^= rp->rng << 13;
+  rp->rng ^= rp->rng >> 17;
+  rp->rng ^= rp->rng << 5;
+  return rp->rng * (1.0 / 4294967296.0);
+}
+
+static void ripple_impulse(Ripple *rp, double x, double y, double strength) {
+  const double cx = x * (rp->cols - 1), cy = y * (rp->rows - 1);
+  const int reach = (int)(3.0 * RIPPLE_DROP_RADIUS);
+  const int x0 = (int)cx - reach < 1 ? 1 : (int)cx - reach;
+  const int x1 = (int)cx + reach > rp->cols - 2 ? rp->cols - 2
+                                                : (int)cx + reach;
+  const int y0 = (int)cy - reach < 1 ? 1 : (int)cy - reach;
+  const int y1 = (int)cy + reach > rp->rows - 2 ? rp->rows - 2
+                                                : (int)cy + reach;
+  for (int j = y0; j <= y1; j++) {
+    for (int i = x0; i <= x1; i++) {
+      const double dx = (i - cx) / RIPPLE_DROP_RADIUS;
+      const double dy = (j - cy) / RIPPLE_DROP_RADIUS;
+      const float d = (float)(strength * exp(-0.5 * (dx * dx + dy * dy)));
+      const size_t k = (size_t)j * (size_t)rp->cols + (size_t)i;
+      rp->h[k] += d;
+      rp->prev[k] += d;
+    }
+  }
+}
+
+// Step through `dt` seconds with random drops at `rate` per second, then
+// shade the result.
+static void ripple_advance(Ripple *rp, WorkerPool *pool, double dt,
+                           double rate) {
+  rp->lag += dt;
+  int steps = 0;
+  for (; rp->lag >= RIPPLE_DT && steps < RIPPLE_MAX_STEPS; steps++) {
+    if (rate > 0.0 && ripple_random(rp) < rate * RIPPLE_DT) {
+      const double x = ripple_random(rp), y = ripple_random(rp);
+      ripple_impulse(rp, x, y, -0.5 - 0.5 * ripple_random(rp));
+    }
+    pool_run(pool, ripple_step_job, rp, ripple_tiles(rp));
+    float *tmp = rp->h;
+    rp->h = rp->prev;
+    rp->prev = tmp;
+    rp->lag -= RIPPLE_DT;
+  }
+  if (steps == RIPPLE_MAX_STEPS)
+    rp->lag = 0.0; // fell behind: skip rather than spiral
+  pool_run(pool, ripple_shade_job, rp, ripple_tiles(rp));
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Perspective ocean
+// ════════════════════════════════════════════════════════════════════
+//
+// 3D mode lays the waves out as plane waves crossing a flat sea and
+// looks at it from just above the surface, drawn in half blocks like the
+// ripple tank. Rendering is the voxel-space scheme: a mesh of heights is
+// sampled on rows of constant depth, then each screen column walks the
+// rows from near to far, projects each height and fills the samples
+// between it and the highest row drawn so far in that column. Farther
+// water only ever appears above nearer water, so every sample is
+// written once and nothing is sorted.
+//
+// A mesh row at depth z covers the screen width with world x linear in
+// the column, so each wave along the row is again a plain sine of the
+// column with its own frequency and phase, and a row costs one
+// add_sine() pass per wave. Waves whose frequency along a far row
+// or across rows exceeds what the samples can show fade out instead of
+// aliasing.
+// Mesh rows and screen columns are both independent, so each pass runs
+// on the worker pool.
+
+#define OCEAN_EYE 1.5         // camera height over calm water
+#define OCEAN_SWELL 0.4       // height of a full crest
+#define OCEAN_NEAR 1.0        // depth of the nearest mesh row
+#define OCEAN_FAR 120.0       // and of the farthest
+#define OCEAN_DEPTH_ROWS 256  // mesh rows, spaced geometrically
+#define OCEAN_HORIZON 0.3     // horizon line, fraction of the height
+#define OCEAN_SCALE 30.0      // world wavenumber per unit of Wave.freq
+#define OCEAN_SPREAD 2.0      // spread of wave headings, radians
+#define OCEAN_DEPTH_TINT 0.5  // palette span from near to far
+#define OCEAN_HEIGHT_TINT 0.2 // palette shift of a full crest
+#define OCEAN_LIGHT 0.2       // palette shift per unit of facing slope
+#define OCEAN_SKY 16          // 256-color index above the horizon
+#define OCEAN_MESH_TILE 8     // mesh rows per tile
+#define OCEAN_COL_TILE 64     // screen columns per tile
+
+typedef struct {
+  int rows, cols;        // samples: two rows per cell
+  double *mesh;          // OCEAN_DEPTH_ROWS x cols normalized heights
+  size_t mesh_cap;
+  unsigned char *color;  // palette index per sample
+  size_t color_cap;
+  double depth[OCEAN_DEPTH_ROWS];
+  double ratio;          // from one mesh row's depth to the next
+  double focal;          // samples per world unit at depth 1
+  double horizon;        // sample row of the horizon
+  const unsigned char *lut;
+
+  // Frame inputs for the passes
+  const Wave *waves;
+  const double *phase;
+  int num_waves;
+  double color_base;
+} Ocean;
+
+static Ocean *ocean_new(const unsigned char *lut) {
+  Ocean *oc = calloc(1, sizeof(*oc));
+  if (!oc)
+    return NULL;
+  oc->lut = lut;
+  oc->ratio = pow(OCEAN_FAR / OCEAN_NEAR, 1.0 / (OCEAN_DEPTH_ROWS - 1));
+  oc->depth[0] = OCEAN_NEAR;
+  for (int i = 1; i < OCEAN_DEPTH_ROWS; i++)
+    oc->depth[i] = oc->depth[i - 1] * oc->ratio;
+  return oc;
+}
+
+static void ocean_free(Ocean *oc) {
+  if (!oc)
+    return;
+  free(oc->mesh);
+  free(oc->color);
+  free(oc);
+}
+
+// Size for a rows x cols frame, with the nearest calm water on the
+// bottom sample row.
+static bool ocean_resize(Ocean *oc, int rows, int cols) {
+  const size_t mesh = (size_t)OCEAN_DEPTH_ROWS * (size_t)cols;
+  if (mesh > oc->mesh_cap) {
+    double *p = realloc(oc->mesh, mesh * sizeof(double));
+    if (!p)
+      return false;
+    oc->mesh = p;
+    oc->mesh_cap = mesh;
+  }
+  const size_t samples = (size_t)rows * 2 * (size_t)cols;
+  if (samples > oc->color_cap) {
+    unsigned char *p = realloc(oc->color, samples);
+    if (!p)
+      return false;
+    oc->color = p;
+    oc->color_cap = samples;
+  }
+  oc->rows = rows * 2;
+  oc->cols = cols;
+  oc->horizon = OCEAN_HORIZON * oc->rows;
+  oc->focal = (oc->rows - oc->horizon) * OCEAN_NEAR / OCEAN_EYE;
+  return true;
+}
+
+// Heights of mesh rows [OCEAN_MESH_TILE * t, ...) across the screen.
+static void ocean_mesh_job(void *arg, int t) {
+  Ocean *oc = arg;
+  const int cols = oc->cols;
+  const int i1 = (t + 1) * OCEAN_MESH_TILE < OCEAN_DEPTH_ROWS
+                     ? (t + 1) * OCEAN_MESH_TILE
+                     : OCEAN_DEPTH_ROWS;
+  for (int i = t * OCEAN_MESH_TILE; i < i1; i++) {
+    const double z = oc->depth[i];
+    const double step = z / oc->focal;       // world x per column
+    const double dz = z * (oc->ratio - 1.0); // and per mesh row
+    double *row = oc->mesh + (size_t)i * (size_t)cols;
+    double power = 0.0;
+    memset(row, 0, (size_t)cols * sizeof(double));
+    for (int w = 0; w < oc->num_waves; w++) {
+      const Wave *wv = &oc->waves[w];
+      // Headings fan out around straight at the camera
+      const double heading =
+          TWO_PI / 4 + (fmod(w * 0.6180339887, 1.0) - 0.5) * OCEAN_SPREAD;
+      const double k = wv->freq * OCEAN_SCALE;
+      const double kx = k * cos(heading), kz = k * sin(heading);
+      const double freq = kx * step;
+      const double fade =
+          1.0 - fmax(fabs(freq), fabs(kz * dz)) / (TWO_PI / 4);
+      power += wv->amp * wv->amp;
+      if (fade <= 0.0)
+        continue;
+      add_sine(row, wv->amp * fade, freq,
+               kz * z - kx * step * (cols / 2) + oc->phase[w], cols);
+    }
+    wave_superpose_norm(row, power, cols);
+  }
+}
+
+// Draw screen columns [OCEAN_COL_TILE * t, ...) front to back.
+static void ocean_column_job(void *arg, int t) {
+  Ocean *oc = arg;
+  const int cols = oc->cols;
+  const int c1 = (t + 1) * OCEAN_COL_TILE < cols ? (t + 1) * OCEAN_COL_TILE
+                                                 : cols;
+  for (int c = t * OCEAN_COL_TILE; c < c1; c++) {
+    int top = oc->rows; // highest sample drawn so far
+    for (int i = 0; i < OCEAN_DEPTH_ROWS && top > 0; i++) {
+      const double h = OCEAN_SWELL * oc->mesh[(size_t)i * (size_t)cols + c];
+      int y = (int)(oc->horizon + (OCEAN_EYE - h) * oc->focal / oc->depth[i]);
+      if (y < 0)
+        y = 0;
+      if (y >= top)
+        continue; // hidden behind nearer water
+      // Slopes facing the camera catch the light
+      const double behind =
+          i + 1 < OCEAN_DEPTH_ROWS
+              ? OCEAN_SWELL * oc->mesh[(size_t)(i + 1) * (size_t)cols + c]
+              : h;
+      const double tint = oc->color_base +
+                          OCEAN_DEPTH_TINT * i / OCEAN_DEPTH_ROWS +
+                          OCEAN_HEIGHT_TINT * (h + 1.0) +
+                          OCEAN_LIGHT * fmax(0.0, behind - h) /
+                              (oc->depth[i] * (oc->ratio - 1.0));
+      const unsigned char color =
+          oc->lut[(int)(fmod(tint, 1.0) * WAVE_LUT_SIZE) &
+                  (WAVE_LUT_SIZE - 1)];
+      for (; top > y; top--)
+        oc->color[(size_t)(top - 1) * (size_t)cols + c] = color;
+    }
+    for (; top > 0; top--)
+      oc->color[(size_t)(top - 1) * (size_t)cols + c] = OCEAN_SKY;
+  }
+}
+
+static void ocean_render(Ocean *oc, WorkerPool *pool, const Wave *waves,
+                         const double *phase, int n, double color_base) {
+  oc->waves = waves;
+  oc->phase = phase;
+  oc->num_waves = n;
+  oc->color_base = color_base;
+  pool_run(pool, ocean_mesh_job, oc,
+           (OCEAN_DEPTH_ROWS + OCEAN_MESH_TILE - 1) / OCEAN_MESH_TILE);
+  pool_run(pool, ocean_column_job, oc,
+           (oc->cols + OCEAN_COL_TILE - 1) / OCEAN_COL_TILE);
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Foam
+// ════════════════════════════════════════════════════════════════════
+//
+// Foam particles are thrown up from the crests of whatever was plotted,
+// then drift, fall back and fade. They live in a structure of arrays
+// allocated once at the capacity the caller asks for: live particles are
+// packed at the front, a dead one is replaced by the last, and spawning
+// stops while the pool is full. A frame is one vectorized pass moving
+// every particle, one pass swap-removing the dead and one binning the
+// rest into per-cell levels that the encoder draws over the waves, so
+// its cost is bounded by the capacity plus the cell count.
+
+#define FOAM_LIFE 1.2      // longest life of a particle, seconds
+#define FOAM_SPAWN 6.0     // particles per crest column per second
+#define FOAM_GRAVITY 5.0   // rows per second, per second
+#define FOAM_DRAG 0.8      // horizontal speed lost per second (fraction)
+#define FOAM_MAX_DT 0.1    // longer frame gaps are not simulated
+
+typedef struct {
+  int count, cap;         // live particles, pool size
+  float *x, *y;           // position in cells, y down from the top row
+  float *vx, *vy;         // cells per second
+  float *life;            // 1 at spawn, dead at 0
+  float *fade;            // life lost per second
+  float *block;           // the six arrays above, lane-padded
+  unsigned char *cell;    // per-cell foam level, 0 = none
+  size_t cell_cap;
+  int *surface;           // per-column top plotted row, -1 = none
+  int surface_cap;
+  double dt;              // simulation time since the last wave_ctx_foam()
+  unsigned int rng;
+} Foam;
+
+static Foam *foam_new(int cap) {
+  Foam *f = calloc(1, sizeof(*f));
+  if (!f)
+    return NULL;
+  const size_t n = (size_t)(cap + SUM_LANES - 1) / SUM_LANES * SUM_LANES;
+  f->block = calloc(6 * n, sizeof(float));
+  if (!f->block) {
+    free(f);
+    return NULL;
+  }
+  float **arrays[] = {&f->x, &f->y, &f->vx, &f->vy, &f->life, &f->fade};
+  for (size_t k = 0; k < 6; k++)
+    *arrays[k] = f->block + k * n;
+  f->cap = cap;
+  f->rng = RNG_SEED ^ 0xC2B2AE35u;
+  return f;
+}
+
+static void foam_free(Foam *f) {
+  if (!f)
+    return;
+  free(f->block);
+  free(f->cell);
+  free(f->surface);
+  free(f);
+}
+
+// Size the per-cell and per-column arrays for a rows x cols frame.
+static bool foam_resize(Foam *f, int rows, int cols) {
+  const size_t cells = (size_t)rows * (size_t)cols;
+  if (cells > f->cell_cap) {
+    unsigned char *cell = realloc(f->cell, cells);
+    if (!cell)
+      return false;
+    f->cell = cell;
+    f->cell_cap = cells;
+  }
+  if (cols > f->surface_cap) {
+    int *surface = realloc(f->surface, (size_t)cols * sizeof(int));
+    if (!surface)
+      return false;
+    f->surface = surface;
+    f->surface_cap = cols;
+  }
+  return true;
+}
+
+static float foam_random(Foam *f) {
+  f->rng ^= f->rng << 13;
+  f->rng ^= f->rng >> 17;
+  f->rng ^= f->rng << 5;
+  return (float)(f->rng * (1.0 / 4294967296.0));
+}
+
+// Move `n` particles (rounded up to whole lane groups; the padding is
+// scratch) by dt seconds.
+static void foam_move(float *restrict x, float *restrict y,
+                      float *restrict vx, float *restrict vy,
+                      float *restrict life, const float *restrict fade,
+                      int n, float dt) {
+  const float drag = 1.0f - (float)FOAM_DRAG * dt;
+  const float fall = (float)FOAM_GRAVITY * dt;
+  for (int i = 0; i < n; i += SUM_LANES) {
+    for (int l = i; l < i + SUM_LANES; l++) {
+      x[l] += vx[l] * dt;
+      y[l] += vy[l] * dt;
+      vy[l] += fall;
+      vx[l] *= drag;
+      life[l] -= fade[l] * dt;
+    }
+  }
+}
+
+// Swap-remove particles that faded or left the sides or the bottom.
+static void foam_compact(Foam *f, int rows, int cols) {
+  for (int i = 0; i < f->count;) {
+    if (f->life[i] > 0.0f && f->x[i] >= 0.0f && f->x[i] < (float)cols &&
+        f->y[i] < (float)rows) {
+      i++;
+      continue;
+    }
+    const int last = --f->count;
+    f->x[i] = f->x[last];
+    f->y[i] = f->y[last];
+    f->vx[i] = f->vx[last];
+    f->vy[i] = f->vy[last];
+    f->life[i] = f->life[last];
+    f->fade[i] = f->fade[last];
+  }
+}
+
+// Find the top plotted row of every column, scanning rows top down
+// until each column has one.
+static void foam_find_surface(Foam *f, const WaveGrid *g) {
+  int missing = g->cols;
+  for (int x = 0; x < g->cols; x++)
+    f->surface[x] = -1;
+  for (int r = 0; r < g->rows && missing; r++) {
+    const int *owner = g->owner + (size_t)r * (size_t)g->cols;
+    for (int x = 0; x < g->cols; x++) {
+      if (owner[x] >= 0 && f->surface[x] < 0) {
+        f->surface[x] = r;
+        missing--;
+      }
+    }
+  }
+}
+
+// Throw particles up from columns that peak above a neighbor and are not
+// below either.
+static void foam_spawn(Foam *f, int cols, float dt) {
+  const int *s = f->surface;
+  for (int x = 1; x < cols - 1 && f->count < f->cap; x++) {
+    if (s[x] < 0 || (s[x - 1] >= 0 && s[x] > s[x - 1]) ||
+        (s[x + 1] >= 0 && s[x] > s[x + 1]) ||
+        (s[x] == s[x - 1] && s[x] == s[x + 1]))
+      continue;
+    for (float due = (float)FOAM_SPAWN * dt + foam_random(f);
+         due >= 1.0f && f->count < f->cap; due -= 1.0f) {
+      const int i = f->count++;
+      f->x[i] = (float)x + foam_random(f);
+      f->y[i] = (float)s[x];
+      f->vx[i] = 4.0f * (foam_random(f) - 0.5f);
+      f->vy[i] = -1.0f - 3.0f * foam_random(f);
+      f->life[i] = 1.0f;
+      f->fade[i] = 1.0f / (float)(FOAM_LIFE * (0.4 + 0.6 * foam_random(f)));
+    }
+  }
+}
+
+// Bin live particles into cells, brightest particle wins.
+static void foam_bin(Foam *f, int rows, int cols) {
+  memset(f->cell, 0, (size_t)rows * (size_t)cols);
+  for (int i = 0; i < f->count; i++) {
+    if (f->y[i] < 0.0f)
+      continue; // spray above the top row
+    const size_t idx = (size_t)f->y[i] * (size_t)cols + (size_t)f->x[i];
+    const unsigned char level =
+        (unsigned char)(1 + (int)(f->life[i] * (FOAM_LEVELS - 0.01f)));
+    if (level > f->cell[idx])
+      f->cell[idx] = level;
+  }
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Rendering context
+// ════════════════════════════════════════════════════════════════════
+//
+// Phases are integrated from t = 0 at each wave's current phase_spd, so
+// callers may retune waves between frames without the animation jumping.
+// One animation tick is 1 / tick_rate seconds of render time. Noise
+// waves also keep their advance unfolded as drift, since the noise
+// field never repeats; all of them are evaluated on the first
+// wave_ctx_wave_columns() call of a frame and cached until the next.
+// In physics mode every wave reads the one simulated string.
+//
+// The Wave array is what callers edit, up to the moment a frame is
+// plotted. wave_ctx_plot() then gathers it into structure-of-arrays form
+// — frequencies, amplitudes, speeds and phases in separate arrays — so
+// the per-column loops stream through dense arrays, and wave_ctx_encode()
+// interns glyph pointers to byte ids so the encoder reads a glyph and its
+// length from a small table instead of chasing a pointer and calling
+// strlen() per cell.
+//
+// A cell shows the last wave that reaches it, as last-write-wins would.
+// Plain sines are plotted column by column: every wave's row in the
+// column is computed in vector lanes and scattered into a per-row table
+// of the topmost wave, and only then are the claimed cells written, so
+// with thousands of waves the grid still sees at most one write per
+// cell. Each column still evaluates all of its waves.
+
+#define GLYPH_TABLE_SIZE 256 // distinct glyphs with byte ids
+
+struct WaveCtx {
+  WaveOptions opt;
+  const unsigned char *lut;
+  wave_columns_fn columns;
+  bool has_formula;
+  WaveFormula formula;
+  Wave *waves;
+  double *soa; // one block holding the arrays below
+  double *freq;
+  double *amp;
+  double *spd;
+  double *phase;
+  double *rot_s; // plain-sine plotting: sin, cos of the current column
+  double *rot_c;
+  double *rot_rs; // and of the step between columns
+  double *rot_rc;
+  int *row;                // row of each wave in the current column
+  int *top;                // top wave of each row in the current column
+  size_t top_cap;          // ints allocated in top
+  unsigned char *glyph_id; // index into glyphs, per wave
+  const char *glyphs[GLYPH_TABLE_SIZE];
+  unsigned char glyph_len[GLYPH_TABLE_SIZE];
+  int num_glyphs; // -1: too many distinct glyphs, encode via waves
+  double *sim_h;      // physics: string heights now
+  double *sim_prev;   // and one step earlier
+  size_t sim_cap;     // doubles allocated in each
+  int sim_cols;       // columns in use, 0 before the first frame
+  double sim_lag;     // simulation time not yet stepped
+  double step_dt;     // simulation time wave_ctx_simulate() still owes
+  bool step_due;      // and it has not run since wave_ctx_begin()
+  unsigned int sim_rng;
+  WorkerPool *pool;   // ripple and 3D modes only
+  Ripple *ripple;     // ripple tank, ripple mode only
+  Ocean *ocean;       // perspective ocean, 3D mode only
+  Foam *foam;         // foam particles, NULL = off
+  double *drift;      // unfolded phase advance, noise waves only
+  double *noise;      // num_waves column arrays of the current frame
+  size_t noise_cap;   // doubles allocated in noise
+  bool noise_valid;   // noise holds this frame's columns
+  double ticks; // animation ticks at the current frame
+  double time;  // formula time t at the current frame
+  WaveGrid grid;
+  size_t grid_cap;    // cells allocated in grid.owner / grid.val
+  double *scratch;
+  size_t scratch_cap; // doubles allocated in scratch
+  unsigned int rng;
+};
+
+// n rounded up to whole groups of SUM_LANES
+static int lane_count(int n) {
+  return (n + SUM_LANES - 1) / SUM_LANES * SUM_LANES;
+}
+
+WaveCtx *wave_ctx_new(const WaveOptions *opt) {
+  if (opt->num_waves < 1)
+    return NULL;
+  const unsigned char *lut =
+      wave_find_palette(opt->palette ? opt->palette : DEFAULT_PALETTE);
+  wave_columns_fn columns =
+      wave_find_generator(opt->generator ? opt->generator : DEFAULT_GENERATOR);
+  if (!lut || !columns)
+    return NULL;
+
+  WaveCtx *ctx = calloc(1, sizeof(*ctx));
+  if (!ctx)
+    return NULL;
+  ctx->opt = *opt;
+  if (ctx->opt.tick_rate <= 0.0)
+    ctx->opt.tick_rate = DEFAULT_TICK_RATE;
+  ctx->lut = lut;
+  ctx->columns = columns;
+  ctx->has_formula = opt->formula != NULL;
+  if (ctx->has_formula &&
+      !wave_formula_compile(&ctx->formula, opt->formula, NULL, 0)) {
+    free(ctx);
+    return NULL;
+  }
+  ctx->rng = RNG_SEED;
+  ctx->sim_rng = RNG_SEED ^ 0x9E3779B9u;
+  // The per-wave arrays are padded to whole SIMD lane groups
+  const size_t n = (size_t)lane_count(opt->num_waves);
+  ctx->waves = malloc((size_t)opt->num_waves * sizeof(Wave));
+  ctx->soa = calloc(8 * n, sizeof(double));
+  ctx->row = malloc(n * sizeof(int));
+  ctx->glyph_id = malloc(n);
+  if (opt->noise)
+    ctx->drift = calloc(n, sizeof(double));
+  if (opt->ripple || opt->ocean)
+    ctx->pool = pool_new(opt->threads);
+  if (opt->ripple)
+    ctx->ripple = ripple_new(lut);
+  if (opt->ocean)
+    ctx->ocean = ocean_new(lut);
+  if (opt->foam > 0)
+    ctx->foam = foam_new(opt->foam);
+  if (!ctx->waves || !ctx->soa || !ctx->row || !ctx->glyph_id ||
+      (opt->noise && !ctx->drift) || (opt->foam > 0 && !ctx->foam) ||
+      ((opt->ripple || opt->ocean) && !ctx->pool) ||
+      (opt->ripple && !ctx->ripple) || (opt->ocean && !ctx->ocean)) {
+    wave_ctx_free(ctx);
+    return NULL;
+  }
+  double **arrays[] = {&ctx->freq,  &ctx->amp,   &ctx->spd,    &ctx->phase,
+                       &ctx->rot_s, &ctx->rot_c, &ctx->rot_rs, &ctx->rot_rc};
+  for (size_t k = 0; k < sizeof(arrays) / sizeof(arrays[0]); k++)
+    *arrays[k] = ctx->soa + k * n;
+  wave_generate(ctx->waves, opt->num_waves, opt->glyph);
+  return ctx;
+}
+
+void wave_ctx_free(WaveCtx *ctx) {
+  if (!ctx)
+    return;
+  free(ctx->waves);
+  free(ctx->soa);
+  free(ctx->row);
+  free(ctx->top);
+  free(ctx->glyph_id);
+  free(ctx->drift);
+  free(ctx->sim_h);
+  free(ctx->sim_prev);
+  ripple_free(ctx->ripple);
+  ocean_free(ctx->ocean);
+  pool_free(ctx->pool);
+  foam_free(ctx->foam);
+  free(ctx->noise);
+  free(ctx->grid.owner);
+  free(ctx->grid.val);
+  free(ctx->scratch);
+  free(ctx);
+}
+
+Wave *wave_ctx_waves(WaveCtx *ctx) { return ctx->waves; }
+
+int wave_ctx_num_waves(const WaveCtx *ctx) { return ctx->opt.num_waves; }
+
+// Give every distinct glyph of the waves a byte id. Neighbouring waves
+// usually share the pointer of a table entry, so strcmp() is rare.
+static void intern_glyphs(WaveCtx *ctx) {
+  ctx->num_glyphs = 0;
+  for (int w = 0; w < ctx->opt.num_waves; w++) {
+    const char *gl = ctx->waves[w].glyph;
+    int k = 0;
+    while (k < ctx->num_glyphs && ctx->glyphs[k] != gl &&
+           strcmp(ctx->glyphs[k], gl) != 0)
+      k++;
+    if (k == ctx->num_glyphs) {
+      size_t len = strlen(gl);
+      if (k == GLYPH_TABLE_SIZE || len > UCHAR_MAX) {
+        ctx->num_glyphs = -1;
+        return;
+      }
+      ctx->glyphs[k] = gl;
+      ctx->glyph_len[k] = (unsigned char)len;
+      ctx->num_glyphs++;
+    }
+    ctx->glyph_id[w] = (unsigned char)k;
+  }
+}
+
+// Size the string for `cols` columns, keeping the overlapping part.
+static bool sim_resize(WaveCtx *ctx, int cols) {
+  if ((size_t)cols > ctx->sim_cap) {
+    double *h = realloc(ctx->sim_h, (size_t)cols * sizeof(double));
+    if (!h)
+      return false;
+    ctx->sim_h = h;
+    double *prev = realloc(ctx->sim_prev, (size_t)cols * sizeof(double));
+    if (!prev)
+      return false;
+    ctx->sim_prev = prev;
+    ctx->sim_cap = (size_t)cols;
+  }
+  for (int x = ctx->sim_cols; x < cols; x++)
+    ctx->sim_h[x] = ctx->sim_prev[x] = 0.0;
+  ctx->sim_h[cols - 1] = ctx->sim_prev[cols - 1] = 0.0;
+  ctx->sim_cols = cols;
+  return true;
+}
+
+static double sim_random(WaveCtx *ctx) {
+  ctx->sim_rng ^= ctx->sim_rng << 13;
+  ctx->sim_rng ^= ctx->sim_rng >> 17;
+  ctx->sim_rng ^= ctx->sim_rng << 5;
+  return ctx->sim_rng * (1.0 / 4294967296.0);
+}
+
+// Step the string through `dt` seconds of simulation time, dropping
+// random impulses at the configured rate.
+static void sim_advance(WaveCtx *ctx, double dt) {
+  const double courant = PHYS_SPEED * PHYS_DT;
+  const double keep = 1.0 - PHYS_DAMPING * PHYS_DT;
+  const double drop_p = ctx->opt.impulse_rate * PHYS_DT;
+  ctx->sim_lag += dt;
+  int steps = 0;
+  for (; ctx->sim_lag >= PHYS_DT && steps < PHYS_MAX_STEPS; steps++) {
+    if (drop_p > 0.0 && sim_random(ctx) < drop_p) {
+      const double x = sim_random(ctx);
+      wave_ctx_impulse(ctx, x, 0.3 + 0.7 * sim_random(ctx));
+    }
+    wave_string_step(ctx->sim_h, ctx->sim_prev, ctx->sim_cols,
+                     courant * courant, keep);
+    double *tmp = ctx->sim_h;
+    ctx->sim_h = ctx->sim_prev;
+    ctx->sim_prev = tmp;
+    ctx->sim_lag -= PHYS_DT;
+  }
+  if (steps == PHYS_MAX_STEPS)
+    ctx->sim_lag = 0.0; // fell behind: skip rather than spiral
+}
+
+void wave_ctx_simulate(WaveCtx *ctx) {
+  if (!ctx->step_due)
+    return;
+  const double dt = ctx->step_dt;
+  ctx->step_due = false; // sim_advance() drops impulses through the API
+  ctx->step_dt = 0.0;
+  if (ctx->opt.physics)
+    sim_advance(ctx, dt);
+  if (ctx->ripple)
+    ripple_advance(ctx->ripple, ctx->pool, dt, ctx->opt.impulse_rate);
+}
+
+void wave_ctx_impulse(WaveCtx *ctx, double x, double strength) {
+  wave_ctx_simulate(ctx); // land on the string as it is this frame
+  const int cols = ctx->sim_cols;
+  if (cols < 3)
+    return;
+  const double at = x * (cols - 1);
+  const int reach = (int)(3.0 * PHYS_DROP_WIDTH);
+  int x0 = (int)at - reach, x1 = (int)at + reach;
+  if (x0 < 1)
+    x0 = 1;
+  if (x1 > cols - 2)
+    x1 = cols - 2;
+  // Displace both steps alike: the string is released from rest
+  for (int i = x0; i <= x1; i++) {
+    const double d = (i - at) / PHYS_DROP_WIDTH;
+    const double dy = strength * exp(-0.5 * d * d);
+    ctx->sim_h[i] += dy;
+    ctx->sim_prev[i] += dy;
+  }
+}
+
+WaveGrid *wave_ctx_begin(WaveCtx *ctx, int rows, int cols, double t) {
+  if (rows < 1 || cols < 1)
+    return NULL;
+  const size_t cells = (size_t)rows * (size_t)cols;
+  if (cells > ctx->grid_cap) {
+    int *owner = realloc(ctx->grid.owner, cells * sizeof(int));
+    if (!owner)
+      return NULL;
+    ctx->grid.owner = owner;
+    double *val = realloc(ctx->grid.val, cells * sizeof(double));
+    if (!val)
+      return NULL;
+    ctx->grid.val = val;
+    ctx->grid_cap = cells;
+  }
+  ctx->grid.rows = rows;
+  ctx->grid.cols = cols;
+  wave_grid_clear(&ctx->grid);
+
+  const int n = ctx->opt.num_waves;
+  for (int w = 0; w < n; w++)
+    ctx->spd[w] = ctx->waves[w].phase_spd;
+
+  // Advance every phase to the new time, folded so sin() keeps precision
+  const double ticks = t * ctx->opt.tick_rate;
+  const double dt = (ticks - ctx->ticks) * ctx->opt.speed_mult;
+  for (int w = 0; w < n; w++)
+    ctx->phase[w] = fmod(ctx->phase[w] + ctx->spd[w] * dt, TWO_PI);
+  if (ctx->drift)
+    for (int w = 0; w < n; w++)
+      ctx->drift[w] += ctx->spd[w] * dt;
+  ctx->noise_valid = false;
+  if (ctx->opt.physics && !sim_resize(ctx, cols))
+    return NULL;
+  if (ctx->ripple && !ripple_resize(ctx->ripple, rows, cols))
+    return NULL;
+  if (ctx->opt.physics || ctx->ripple) {
+    ctx->step_dt += t * ctx->opt.speed_mult - ctx->time;
+    ctx->step_due = true;
+  }
+  if (ctx->ocean && !ocean_resize(ctx->ocean, rows, cols))
+    return NULL;
+  if (ctx->foam) {
+    if (!foam_resize(ctx->foam, rows, cols))
+      return NULL;
+    ctx->foam->dt += t * ctx->opt.speed_mult - ctx->time;
+  }
+  ctx->ticks = ticks;
+  ctx->time = t * ctx->opt.speed_mult;
+  return &ctx->grid;
+}
+
+double wave_ctx_color_base(const WaveCtx *ctx) {
+  return ctx->ticks / WAVE_COLOR_PERIOD;
+}
+
+double *wave_ctx_scratch(WaveCtx *ctx, size_t n) {
+  const size_t need = n * (size_t)ctx->grid.cols;
+  if (need > ctx->scratch_cap) {
+    double *p = realloc(ctx->scratch, need * sizeof(double));
+    if (!p)
+      return NULL;
+    ctx->scratch = p;
+    ctx->scratch_cap = need;
+  }
+  return ctx->scratch;
+}
+
+// Evaluate every noise wave of the frame into the cache. False if the
+// cache cannot be allocated.
+static bool noise_fill(WaveCtx *ctx) {
+  const int cols = ctx->grid.cols;
+  const size_t need = (size_t)ctx->opt.num_waves * (size_t)cols;
+  if (need > ctx->noise_cap) {
+    double *p = realloc(ctx->noise, need * sizeof(double));
+    if (!p)
+      return false;
+    ctx->noise = p;
+    ctx->noise_cap = need;
+  }
+  for (int w = 0; w < ctx->opt.num_waves; w++)
+    wave_column_simplex(&ctx->waves[w], w, ctx->drift[w], WAVE_NOISE_OCTAVES,
+                        cols, ctx->noise + (size_t)w * cols);
+  ctx->noise_valid = true;
+  return true;
+}
+
+void wave_ctx_wave_columns(WaveCtx *ctx, int w, double *ys) {
+  const int cols = ctx->grid.cols;
+  if (ctx->opt.physics) {
+    wave_ctx_simulate(ctx);
+    for (int x = 0; x < cols; x++)
+      ys[x] = fmax(-1.0, fmin(1.0, ctx->sim_h[x]));
+  } else if (ctx->opt.noise) {
+    if (ctx->noise_valid || noise_fill(ctx))
+      memcpy(ys, ctx->noise + (size_t)w * cols, (size_t)cols * sizeof(double));
+    else // no cache: evaluate this wave alone
+      wave_column_simplex(&ctx->waves[w], w, ctx->drift[w],
+                          WAVE_NOISE_OCTAVES, cols, ys);
+  } else if (ctx->has_formula) {
+    const WaveFormulaVars vars = {ctx->time, w, ctx->opt.num_waves,
+                                  ctx->waves[w].freq, ctx->phase[w]};
+    wave_formula_eval(&ctx->formula, &vars, ctx->grid.cols, ys);
+  } else {
+    ctx->columns(&ctx->waves[w], ctx->phase[w], ctx->grid.cols, ys);
+  }
+}
+
+// True when every wave is a plain sine from the built-in kernels, which
+// the rotation fast paths reproduce.
+static bool plain_sines(const WaveCtx *ctx) {
+  if (ctx->opt.noise || ctx->has_formula)
+    return false;
+  if (ctx->columns == wave_column_sine)
+    return true;
+  if (ctx->columns != wave_column_shape)
+    return false;
+  for (int w = 0; w < ctx->opt.num_waves; w++)
+    if (!plain_sine(&ctx->waves[w]))
+      return false;
+  return true;
+}
+
+bool wave_ctx_superpose(WaveCtx *ctx, double *ys) {
+  const int n = ctx->opt.num_waves, cols = ctx->grid.cols;
+  if (plain_sines(ctx)) {
+    wave_superpose(ctx->waves, ctx->phase, n, cols, ys);
+    return true;
+  }
+
+  double *tmp = wave_ctx_scratch(ctx, 2);
+  if (!tmp)
+    return false;
+  tmp += cols; // the first array may be ys itself
+  double power = 0.0;
+  memset(ys, 0, (size_t)cols * sizeof(double));
+  for (int w = 0; w < n; w++) {
+    wave_ctx_wave_columns(ctx, w, tmp);
+    wave_superpose_add(ys, tmp, ctx->waves[w].amp, cols);
+    power += ctx->waves[w].amp * ctx->waves[w].amp;
+  }
+  wave_superpose_norm(ys, power, cols);
+  return true;
+}
+
+// wave_plot_column() for top-down plotting: only empty cells are taken.
+static void plot_column_under(WaveGrid *g, int w, const double *ys,
+                              int mid_y, double scale, double color_base) {
+  const int rows = g->rows, cols = g->cols;
+  for (int x = 0; x < cols; x++) {
+    if (isnan(ys[x]))
+      continue;
+    int y = mid_y + (int)(scale * ys[x]);
+    if (y >= 0 && y < rows) {
+      size_t idx = (size_t)y * (size_t)cols + (size_t)x;
+      if (g->owner[idx] < 0) {
+        g->owner[idx] = w;
+        g->val[idx] = (double)x / cols + color_base;
+      }
+    }
+  }
+}
+
+// Turn each (s, c) pair by its step (rs, rc); n is a multiple of
+// SUM_LANES.
+static void rotate_lanes(double *restrict s, double *restrict c,
+                         const double *restrict rs,
+                         const double *restrict rc, int n) {
+  for (int w0 = 0; w0 < n; w0 += SUM_LANES) {
+    for (int l = 0; l < SUM_LANES; l++) {
+      const int w = w0 + l;
+      const double t = s[w] * rc[w] + c[w] * rs[w];
+      c[w] = c[w] * rc[w] - s[w] * rs[w];
+      s[w] = t;
+    }
+  }
+}
+
+// Size the per-row slots of plot_sines() for the current grid.
+static bool reserve_top(WaveCtx *ctx) {
+  const size_t need = (size_t)ctx->grid.rows + 1;
+  if (need > ctx->top_cap) {
+    int *p = realloc(ctx->top, need * sizeof(int));
+    if (!p)
+      return false;
+    ctx->top = p;
+    ctx->top_cap = need;
+  }
+  return true;
+}
+
+// Column-major plot of plain sines. Each wave's (sin, cos) pair turns by
+// its frequency per column in dense arrays the compiler vectorizes. A
+// column then scatters wave indices into a per-row slot in wave order,
+// so each slot ends up holding its top wave, and only those reach the
+// grid: one write per covered cell however many waves overlap.
+static void plot_sines(WaveCtx *ctx) {
+  WaveGrid *g = &ctx->grid;
+  const int n = ctx->opt.num_waves, rows = g->rows, cols = g->cols;
+  const int lanes = lane_count(n);
+  const int mid_y = rows / 2;
+  const double color_base = wave_ctx_color_base(ctx);
+  const double *restrict amp = ctx->amp, *restrict s = ctx->rot_s;
+  int *restrict row = ctx->row;
+  int *restrict top = ctx->top; // rows + 1 slots, the last for off-grid
+
+  for (int w = 0; w < n; w++) {
+    ctx->rot_s[w] = sin(ctx->phase[w]);
+    ctx->rot_c[w] = cos(ctx->phase[w]);
+    ctx->rot_rs[w] = sin(ctx->freq[w]);
+    ctx->rot_rc[w] = cos(ctx->freq[w]);
+  }
+
+  for (int x = 0; x < cols; x++) {
+    for (int w0 = 0; w0 < lanes; w0 += SUM_LANES) {
+      for (int l = 0; l < SUM_LANES; l++) {
+        const int y = mid_y + (int)(amp[w0 + l] * mid_y * s[w0 + l]);
+        row[w0 + l] = y >= 0 && y < rows ? y : rows;
+      }
+    }
+    for (int y = 0; y <= rows; y++)
+      top[y] = -1;
+    for (int w = 0; w < n; w++)
+      top[row[w]] = w;
+
+    const double val = (double)x / cols + color_base;
+    for (int y = 0; y < rows; y++) {
+      if (top[y] >= 0) {
+        size_t idx = (size_t)y * (size_t)cols + (size_t)x;
+        g->owner[idx] = top[y];
+        g->val[idx] = val;
+      }
+    }
+    rotate_lanes(ctx->rot_s, ctx->rot_c, ctx->rot_rs, ctx->rot_rc, lanes);
+  }
+}
+
+void wave_ctx_ripple_impulse(WaveCtx *ctx, double x, double y,
+                             double strength) {
+  wave_ctx_simulate(ctx);
+  if (ctx->ripple && ctx->ripple->rows >= 3 && ctx->ripple->cols >= 3)
+    ripple_impulse(ctx->ripple, x, y, strength);
+}
+
+bool wave_ctx_plot(WaveCtx *ctx) {
+  wave_ctx_simulate(ctx);
+  if (ctx->ripple)
+    return true; // shaded while stepping
+  if (ctx->ocean) {
+    ocean_render(ctx->ocean, ctx->pool, ctx->waves, ctx->phase,
+                 ctx->opt.num_waves, wave_ctx_color_base(ctx));
+    return true;
+  }
+  double *ys = wave_ctx_scratch(ctx, ctx->opt.superpose ? 2 : 1);
+  if (!ys)
+    return false;
+  const int mid_y = ctx->grid.rows / 2;
+  const double color_base = wave_ctx_color_base(ctx);
+  if (ctx->opt.physics) {
+    wave_ctx_wave_columns(ctx, 0, ys);
+    wave_plot_column(&ctx->grid, 0, ys, mid_y, mid_y, color_base);
+    return true;
+  }
+  if (ctx->opt.superpose) {
+    if (!wave_ctx_superpose(ctx, ys))
+      return false;
+    if (ctx->opt.superpose == WAVE_SUPERPOSE_INTENSITY)
+      wave_plot_intensity(&ctx->grid, 0, ys, color_base);
+    else
+      wave_plot_column(&ctx->grid, 0, ys, mid_y, mid_y, color_base);
+    return true;
+  }
+  for (int w = 0; w < ctx->opt.num_waves; w++) {
+    ctx->freq[w] = ctx->waves[w].freq;
+    ctx->amp[w] = ctx->waves[w].amp;
+  }
+  if (plain_sines(ctx) && reserve_top(ctx)) {
+    plot_sines(ctx);
+    return true;
+  }
+  for (int w = ctx->opt.num_waves - 1; w >= 0; w--) {
+    wave_ctx_wave_columns(ctx, w, ys);
+    plot_column_under(&ctx->grid, w, ys, mid_y, ctx->amp[w] * mid_y,
+                      color_base);
+  }
+  return true;
+}
+
+void wave_ctx_foam(WaveCtx *ctx) {
+  Foam *f = ctx->foam;
+  if (!f || ctx->ripple || ctx->ocean)
+    return;
+  const int rows = ctx->grid.rows, cols = ctx->grid.cols;
+  float dt = (float)f->dt;
+  dt = dt < 0.0f ? 0.0f : (dt > FOAM_MAX_DT ? (float)FOAM_MAX_DT : dt);
+  foam_move(f->x, f->y, f->vx, f->vy, f->life, f->fade, f->count, dt);
+  foam_compact(f, rows, cols);
+  foam_find_surface(f, &ctx->grid);
+  foam_spawn(f, cols, dt);
+  foam_bin(f, rows, cols);
+  f->dt = 0.0; // a second call in the same frame only spawns
+}
+
+size_t wave_ctx_encode(WaveCtx *ctx, int origin_row, char *buf, size_t cap) {
+  wave_ctx_simulate(ctx);
+  if (ctx->ripple)
+    return encode_halfblocks(ctx->ripple->color, ctx->ripple->rows / 2,
+                             ctx->ripple->cols, origin_row, buf, cap);
+  if (ctx->ocean)
+    return encode_halfblocks(ctx->ocean->color, ctx->ocean->rows / 2,
+                             ctx->ocean->cols, origin_row, buf, cap);
+  intern_glyphs(ctx);
+  const unsigned char *ids = ctx->num_glyphs >= 0 ? ctx->glyph_id : NULL;
+  const unsigned char *foam = ctx->foam ? ctx->foam->cell : NULL;
+  return encode_grid(&ctx->grid, ctx->waves, ids, ctx->glyphs, ctx->glyph_len,
+                     foam, ctx->lut, &ctx->rng, origin_row, buf, cap);
+}
+
+size_t wave_render(WaveCtx *ctx, int rows, int cols, double t, char *buf,
+                   size_t cap) {
+  if (!wave_ctx_begin(ctx, rows, cols, t) || !wave_ctx_plot(ctx))
+    return 0;
+  wave_ctx_foam(ctx);
+  return wave_ctx_encode(ctx, 0, buf, cap);
+}
@@ -0,0 +1,372 @@
+// libwave.h — Embeddable terminal wave renderer
+// Renders animated waves as 256-color ANSI text into caller buffers.
+//
+// Copyright (c) 2026. MIT License.
+//
+// Two layers:
+//  - Stateless kernels (palettes, column kernels, grid rasterizers and
+//    the ANSI encoder) that work on caller-owned memory and never
+//    allocate. They are reentrant.
+//  - A WaveCtx holding options, waves and buffers, with calls that
+//    render a frame for a given size and time. Contexts are independent;
+//    one context must not be used from two threads at once.
+//
+// Library calls never print or exit. Allocation failures are reported
+// through return values (NULL / 0 / false).
+//
+// Palettes and wave generators live in a process-wide registry that
+// plugins extend through WaveRegistry. Register before creating
+// contexts; the registry itself is not thread-safe.
+
+#ifndef LIBWAVE_H
+#define LIBWAVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define LIBWAVE_VERSION "1.0.0"
+
+#define WAVE_MAX_BYTES_PER_CELL 30 // ANSI escape + UTF-8 glyph + reset
+#define WAVE_FRAME_PADDING 256     // extra headroom for frame buffer
+#define WAVE_COLOR_PERIOD 200.0    // animation ticks per palette cycle
+#define WAVE_LUT_SIZE 1024         // palette samples per color cycle (pow2)
+#define WAVE_MAX_PALETTES 64       // registry capacity, built-ins included
+#define WAVE_MAX_GENERATORS 32
+#define WAVE_MAX_HARMONICS 8       // harmonic weights per wave
+#define WAVE_NOISE_OCTAVES 3       // fBm octaves of --noise waves
+#define WAVE_FORMULA_MAX_CODE 128  // bytecode instructions per formula
+#define WAVE_FORMULA_MAX_STACK 16  // evaluation stack depth
+#define WAVE_FORMULA_BLOCK 256     // columns evaluated per instruction pass
+
+// ════════════════════════════════════════════════════════════════════
+//  Types
+// ════════════════════════════════════════════════════════════════════
+
+// ── Wave shapes ────────────────────────────────────────────────────
+typedef enum {
+  WAVE_SHAPE_SINE,
+  WAVE_SHAPE_SQUARE,
+  WAVE_SHAPE_TRIANGLE,
+  WAVE_SHAPE_SAW,
+  WAVE_SHAPE_NOISE,
+  WAVE_NUM_SHAPES,
+} WaveShape;
+
+typedef struct {
+  double freq;
+  double amp;
+  double phase_spd;
+  const char *glyph;
+  int shape; // WaveShape of the base waveform
+  // Relative weights of harmonics 1..num_harmonics of the base; the sum
+  // is normalized to the wave's amplitude. 0 = fundamental only.
+  int num_harmonics;
+  double harmonics[WAVE_MAX_HARMONICS];
+} Wave;
+
+// ── Superposition display ──────────────────────────────────────────
+typedef enum {
+  WAVE_SUPERPOSE_OFF,       // every wave drawn on its own
+  WAVE_SUPERPOSE_LINE,      // the summed displacement as one wave
+  WAVE_SUPERPOSE_INTENSITY, // its square as bars from the bottom row
+} WaveSuperpose;
+
+// ── Cell grid ──────────────────────────────────────────────────────
+// owner[] holds the wave plotted in each cell (-1 = empty) and val[]
+// its color phase. Both are rows * cols, row-major.
+typedef struct {
+  int rows;
+  int cols;
+  int *owner;
+  double *val;
+} WaveGrid;
+
+// ── Context options ────────────────────────────────────────────────
+typedef struct {
+  int num_waves;
+  double speed_mult;
+  double tick_rate;      // animation ticks per second of render time
+  const char *palette;   // NULL = "rainbow"
+  const char *glyph;     // NULL = use per-wave defaults
+  const char *generator; // NULL = "shape"
+  const char *formula;   // overrides generator when set
+  bool noise;            // simplex noise waves, overrides both
+  int superpose;         // WaveSuperpose: sum the waves per column
+  bool physics;          // simulated damped string, overrides all above
+  double impulse_rate;   // physics, ripple: random impulses per second
+  bool ripple;           // 2D ripple tank, replaces the waves entirely
+  bool ocean;            // 3D perspective ocean of the waves
+  int threads;           // ripple, ocean: rendering threads, 0 = CPUs
+  int foam;              // foam particle capacity, 0 = no foam
+} WaveOptions;
+
+// ── Compiled formula ───────────────────────────────────────────────
+// Bytecode for a stack machine whose values are whole column blocks.
+// Plain data with no heap, so it can live on the stack; fields are
+// private to libwave.
+typedef struct {
+  unsigned char op;
+  unsigned char arg;
+  double k;
+} WaveFormulaIns;
+
+typedef struct {
+  WaveFormulaIns code[WAVE_FORMULA_MAX_CODE];
+  int len;
+} WaveFormula;
+
+// ── Formula inputs ─────────────────────────────────────────────────
+// Per-wave scalars a formula may read besides the column index x.
+typedef struct {
+  double t;     // render time in seconds, scaled by the speed multiplier
+  double i;     // wave index
+  double n;     // number of waves
+  double freq;  // the wave's frequency (f)
+  double phase; // the wave's accumulated phase (p)
+} WaveFormulaVars;
+
+typedef struct WaveCtx WaveCtx;
+
+// ════════════════════════════════════════════════════════════════════
+//  Plugin ABI
+// ════════════════════════════════════════════════════════════════════
+//
+// A plugin is a shared object exporting
+//
+//     int wave_plugin_init(const WaveRegistry *reg);
+//
+// which checks reg->abi_version, registers its palettes and generators
+// and returns 0. Plugins never link against libwave: every call goes
+// through the registry table. Both hooks are batched — a palette fills
+// its whole lookup table once at registration, and a generator fills a
+// whole column array per wave per frame — so nothing of the plugin runs
+// per cell. Names and code must stay loaded for the life of the process.
+//
+// The ABI is this section plus the Wave layout. Fields may be appended
+// to Wave; incompatible changes bump WAVE_PLUGIN_ABI.
+
+#define WAVE_PLUGIN_ABI 1
+#define WAVE_PLUGIN_ENTRY "wave_plugin_init"
+
+/// Fill lut[0..n) with 256-color indices for the color phases i / n.
+typedef void (*wave_lut_fn)(unsigned char *lut, int n);
+
+/// Fill ys[0..cols) with one wave's displacement in [-1, 1] at the
+/// given phase. NaN leaves a column empty.
+typedef void (*wave_columns_fn)(const Wave *wv, double phase, int cols,
+                                double *ys);
+
+typedef struct {
+  const char *name;
+  wave_lut_fn build_lut;
+} WavePaletteDef;
+
+typedef struct {
+  const char *name;
+  wave_columns_fn columns;
+} WaveGeneratorDef;
+
+typedef struct {
+  int abi_version;
+  bool (*add_palette)(const WavePaletteDef *def);
+  bool (*add_generator)(const WaveGeneratorDef *def);
+} WaveRegistry;
+
+typedef int (*wave_plugin_init_fn)(const WaveRegistry *reg);
+
+// ════════════════════════════════════════════════════════════════════
+//  Stateless kernels
+// ════════════════════════════════════════════════════════════════════
+
+/// The registry handed to plugins.
+const WaveRegistry *wave_registry(void);
+
+/// Add a palette or generator. False if the name is taken, the registry
+/// is full or a hook is missing.
+bool wave_register_palette(const WavePaletteDef *def);
+bool wave_register_generator(const WaveGeneratorDef *def);
+
+int wave_palette_count(void);
+const char *wave_palette_name(int i);
+int wave_generator_count(void);
+const char *wave_generator_name(int i);
+
+/// Look up a palette's WAVE_LUT_SIZE-entry color table by name
+/// (case-insensitive). NULL if unknown.
+const unsigned char *wave_find_palette(const char *name);
+
+/// Look up a generator by name (case-insensitive). NULL if unknown.
+wave_columns_fn wave_find_generator(const char *name);
+
+/// Fill `n` waves with the default spread of frequency, amplitude and
+/// speed. glyph_override, if set, is used for every wave.
+void wave_generate(Wave *waves, int n, const char *glyph_override);
+
+/// Fill ys[x] with a wave's sine displacement for every column.
+void wave_column_sine(const Wave *wv, double phase, int cols, double *ys);
+
+/// Fill ys[x] with a wave's shape and harmonic series for every column.
+/// Plain sines take the wave_column_sine() path.
+void wave_column_shape(const Wave *wv, double phase, int cols, double *ys);
+
+/// Fill ys[x] with fractal 2D simplex noise in [-1, 1] for wave
+/// number w. The field scrolls and evolves with `drift`, the wave's
+/// unfolded phase advance (phase_spd per tick since t = 0).
+void wave_column_simplex(const Wave *wv, int w, double drift, int octaves,
+                         int cols, double *ys);
+
+/// Sum n plain sines (amplitude-weighted, shapes ignored) at the given
+/// phases into ys, normalized as wave_superpose_norm() does.
+void wave_superpose(const Wave *waves, const double *phase, int n, int cols,
+                    double *ys);
+
+/// Superposition of any column arrays: add amp * ys into acc for each
+/// wave, then scale acc into [-1, 1] by the summed squared amplitudes.
+void wave_superpose_add(double *acc, const double *ys, double amp, int cols);
+void wave_superpose_norm(double *acc, double power, int cols);
+
+/// One leapfrog step of the damped 1D wave equation over `cols` heights
+/// with both ends fixed. `prev` holds the previous step on entry and the
+/// next one on return; swap the pointers afterwards. r2 is the squared
+/// Courant number (stable up to 1) and keep = 1 - damping * dt.
+void wave_string_step(const double *h, double *prev, int cols, double r2,
+                      double keep);
+
+/// Shape names ("sine", "square", "triangle", "saw", "noise").
+const char *wave_shape_name(int shape);
+
+/// Look up a shape by name (case-insensitive). -1 if unknown.
+int wave_find_shape(const char *name);
+
+/// Mark every cell of the grid empty.
+void wave_grid_clear(WaveGrid *g);
+
+/// Rasterize one column array (values in [-1, 1], NaN = gap) as wave
+/// `w`: row = mid_y + scale * ys[x].
+void wave_plot_column(WaveGrid *g, int w, const double *ys, int mid_y,
+                      double scale, double color_base);
+
+/// Rasterize per-column vertical spans between lo[x] and hi[x] (same
+/// units as wave_plot_column), filling every cell in between.
+void wave_plot_span(WaveGrid *g, int w, const double *lo, const double *hi,
+                    int mid_y, double scale, double color_base);
+
+/// Rasterize a superposition as intensity: a bar of ys[x]^2 * rows cells
+/// rising from the bottom row, colored further along the palette with
+/// height.
+void wave_plot_intensity(WaveGrid *g, int w, const double *ys,
+                         double color_base);
+
+/// Encode the grid as ANSI text. Rows are separated by newlines, or each
+/// starts with an absolute cursor move when origin_row (1-based) is set.
+/// `lut` is a palette table from wave_find_palette(). `rng` seeds the
+/// starfield and is advanced. Stops early rather than overflow `cap`;
+/// returns the bytes written.
+size_t wave_encode(const WaveGrid *g, const Wave *waves,
+                   const unsigned char *lut, unsigned int *rng,
+                   int origin_row, char *buf, size_t cap);
+
+/// Buffer size that always holds one encoded rows x cols frame.
+size_t wave_frame_capacity(int rows, int cols);
+
+// ════════════════════════════════════════════════════════════════════
+//  Formula expressions
+// ════════════════════════════════════════════════════════════════════
+//
+// Grammar: numbers, variables x t i n f p, the constant pi, + - * / %
+// (fmod) ^ (pow), unary minus, parentheses and the functions sin cos tan
+// tanh abs sqrt exp log floor min max. Output is in the same units as a
+// generator's: [-1, 1] spans the wave's amplitude and NaN leaves a gap.
+
+/// Compile `src` into `out`. On a syntax error returns false and writes
+/// a message naming the offending column to `err`.
+bool wave_formula_compile(WaveFormula *out, const char *src, char *err,
+                          size_t errcap);
+
+/// Evaluate a compiled formula for columns 0..cols-1 into ys.
+void wave_formula_eval(const WaveFormula *f, const WaveFormulaVars *v,
+                       int cols, double *ys);
+
+// ════════════════════════════════════════════════════════════════════
+//  Rendering context
+// ════════════════════════════════════════════════════════════════════
+
+/// Create a context. Returns NULL on an unknown palette or generator, a
+/// formula that does not compile, a wave count below 1, or out of
+/// memory. String options must outlive the context.
+WaveCtx *wave_ctx_new(const WaveOptions *opt);
+
+void wave_ctx_free(WaveCtx *ctx);
+
+/// The context's waves; callers may change freq/amp/phase_spd/glyph
+/// between frames.
+Wave *wave_ctx_waves(WaveCtx *ctx);
+int wave_ctx_num_waves(const WaveCtx *ctx);
+
+/// Start a frame of rows x cols at render time `t` seconds: size and
+/// clear the grid. In physics or ripple mode the simulation is left to
+/// be stepped up to `t` by wave_ctx_simulate().
+/// Returns the grid, or NULL if it cannot be allocated.
+WaveGrid *wave_ctx_begin(WaveCtx *ctx, int rows, int cols, double t);
+
+/// Physics and ripple modes: step the simulation up to the time of the
+/// current frame. Optional; the first call that reads or disturbs the
+/// simulation does it otherwise. Never allocates.
+void wave_ctx_simulate(WaveCtx *ctx);
+
+/// Color phase of the current frame, for custom wave_plot_* calls.
+double wave_ctx_color_base(const WaveCtx *ctx);
+
+/// Scratch space for `n` column arrays of the current width, valid until
+/// the next wave_ctx_begin(). NULL if it cannot be allocated.
+double *wave_ctx_scratch(WaveCtx *ctx, size_t n);
+
+/// Physics mode: displace the string around x (0 = left edge, 1 = right)
+/// by `strength` (1 = half the frame height, positive is down the
+/// screen). Never allocates; ignored until the first frame has sized the
+/// string.
+void wave_ctx_impulse(WaveCtx *ctx, double x, double strength);
+
+/// Ripple mode: raise the water around (x, y), both fractions of the
+/// frame from the top left, by `strength` (1 = a full palette swing;
+/// negative makes a trough). Never allocates; ignored until the first
+/// frame has sized the tank. wave_ctx_plot() is a no-op in ripple mode and
+/// wave_ctx_encode() draws the tank as half blocks, two samples per cell.
+void wave_ctx_ripple_impulse(WaveCtx *ctx, double x, double y,
+                             double strength);
+
+/// Fill ys with wave w's displacement at the current frame time, using
+/// the context's string, noise, formula or generator. Noise for all waves is
+/// computed on the first call of a frame and served from a cache.
+void wave_ctx_wave_columns(WaveCtx *ctx, int w, double *ys);
+
+/// Fill ys with the superposition of all waves at the current frame
+/// time. Works in the second array of wave_ctx_scratch(ctx, 2), so ys
+/// may be the first. False if scratch space cannot be allocated.
+bool wave_ctx_superpose(WaveCtx *ctx, double *ys);
+
+/// Plot every wave of the context around the middle row, or their
+/// superposition when the superpose option is set. In ocean mode, render
+/// the waves as a sea in perspective instead, which wave_ctx_encode()
+/// draws in half blocks. Returns false if scratch space cannot be
+/// allocated.
+bool wave_ctx_plot(WaveCtx *ctx);
+
+/// Foam: move the frame's foam particles, throw new ones up from the
+/// crests of everything plotted so far and bin them into cells that
+/// wave_ctx_encode() draws over the waves. Call once per frame between
+/// the last plot and the encode; a no-op without opt.foam. Never
+/// allocates.
+void wave_ctx_foam(WaveCtx *ctx);
+
+/// Encode the current grid, with any foam on top; see wave_encode().
+size_t wave_ctx_encode(WaveCtx *ctx, int origin_row, char *buf, size_t cap);
+
+/// Render a complete frame for the given size and time into buf, which
+/// should hold wave_frame_capacity(rows, cols) bytes. Rows are newline
+/// separated, without cursor movement. Returns bytes written, 0 on
+/// allocation failure.
+size_t wave_render(WaveCtx *ctx, int rows, int cols, double t, char *buf,
+                   size_t cap);
+
+#endif // LIBWAVE_H
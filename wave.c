@@ -5,29 +5,51 @@
 
 #define WAVE_VERSION "1.0.0"
 
+#define _GNU_SOURCE // splice(), F_SETPIPE_SZ, accept4(), CPU_SET()
+
+#ifndef WAVE_NO_PLUGINS
+#include <dlfcn.h>
+#endif
+#include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <linux/perf_event.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <math.h>
+#ifndef WAVE_NO_RESOLVER
+#include <netdb.h>
+#endif
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "libwave.h"
+
 // ════════════════════════════════════════════════════════════════════
 //  Constants
 // ════════════════════════════════════════════════════════════════════
 
-#define MAX_BYTES_PER_CELL 30     // ANSI escape + UTF-8 glyph + reset
-#define FRAME_BUF_PADDING 256     // extra headroom for frame buffer
-#define STARFIELD_DENSITY 600     // 1-in-N chance of a star per cell
-#define STARFIELD_GRAY_BASE 236   // base 256-color grayscale index
-#define STARFIELD_GRAY_RANGE 4    // number of gray shades available
-#define FRAME_COLOR_DIVISOR 200.0 // frame counter → color phase divisor
-#define WAVE_COLOR_OFFSET 0.18    // per-wave color phase offset
 #define TWO_PI 6.2831853071795864
 
 #define DEFAULT_FPS 60
@@ -38,246 +60,3206 @@
 #define MIN_FPS 1
 #define MAX_FPS 240
 #define MIN_WAVES 1
-#define MAX_WAVES 50
+#define MAX_WAVES 4096
+#define MAX_SERIES 50     // waves driven by --audio/--stream/--file/--sys/--pv
+#define MAX_WAVE_SPECS 64 // --wave options
+#define MAX_HEIGHT 1000
+
+#define AUDIO_FFT_LOG2 10
+#define AUDIO_FFT_SIZE (1 << AUDIO_FFT_LOG2) // samples per spectrum
+#define AUDIO_RING_SIZE 16384                // PCM ring capacity (pow2)
+#define AUDIO_READ_CHUNK 512                 // samples per read() call
+#define AUDIO_DEFAULT_RATE 44100             // assumed input sample rate
+#define AUDIO_MIN_HZ 40.0                    // lowest band edge
+#define AUDIO_PEAK_DECAY 0.995               // per-frame auto-gain release
+#define AUDIO_NOISE_FLOOR 1e-3               // band energy treated as silence
+#define AUDIO_ATTACK 0.60                    // level smoothing when rising
+#define AUDIO_RELEASE 0.15                   // level smoothing when falling
+
+#define STREAM_HISTORY 4096     // samples kept per series (pow2)
+#define STREAM_READ_SIZE 65536  // bytes per read() of stdin
+#define STREAM_MAX_READS 16     // read() calls per frame at most
+
+#define FILE_FANOUT 16      // samples per pyramid block, per level
+#define FILE_MAX_LEVELS 16  // enough for 16^16 samples
+#define FILE_MIN_SPP 0.125  // deepest zoom: 8 columns per sample
+#define FILE_MAX_CHANNELS MAX_SERIES
+
+#define SYS_DEFAULT_INTERVAL 500 // ms between /proc samples
+#define SYS_READ_SIZE 65536      // pread() buffer for one /proc file
+#define SYS_IO_METRICS 4         // net rx, net tx, disk read, disk write
+#define SYS_MAX_DISK_LINES 256   // diskstats lines considered
+#define SYS_PEAK_DECAY 0.98      // per-sample auto-scale release
+#define SYS_RATE_FLOOR 4096.0    // bytes/s treated as idle
+#define SYS_EASE 0.12            // per-frame glide toward a new sample
+#define SYS_MIN_AMP 0.04         // amplitude of an idle metric
+
+#define PV_SPLICE_CHUNK (1 << 20) // bytes per splice() call
+#define PV_PIPE_SIZE (1 << 20)    // kernel pipe size when bouncing
+#define PV_PEAK_DECAY 0.998       // per-frame auto-scale release
+#define PV_RATE_FLOOR 1024.0      // bytes/s treated as idle
+#define PV_MIN_TAU 0.05           // averaging window of the first wave (s)
+#define PV_MAX_TAU 5.0            // averaging window of the last wave (s)
+
+#define WRAP_STRIP_ROWS 4   // wave strip height under a wrapped command
+#define WRAP_BUF_SIZE 65536 // bytes forwarded per read() of the pty
+
+#define PROGRESS_BUF_SIZE 4096 // bytes of pending progress input
+#define PROGRESS_EASE 0.15     // per-tick glide toward a new value
+
+#define PHYSICS_DEFAULT_RATE 1.5 // random impulses per second
+#define PHYSICS_PLUCK 0.8        // strength of a key-triggered impulse
+#define RIPPLE_DEFAULT_RATE 2.0  // random --ripple drops per second
+#define RIPPLE_CLICK 1.0         // strength of a mouse click in the tank
+#define RIPPLE_DRAG 0.3          // and of each step of a drag
+#define RIPPLE_MAX_THREADS 64
+#define FOAM_DEFAULT_PARTICLES 4096
+#define FOAM_MAX_PARTICLES (1 << 20)
+
+#define METRICS_RING_SIZE 1024 // frame records awaiting the writer (pow2)
+#define METRICS_DRAIN_MS 100   // writer thread wake-up interval
+#define METRICS_OUT_SIZE 65536 // formatted bytes per write() at most
+
+#define PROM_MAX_CLIENTS 8          // scrapes served at the same time
+#define PROM_REQUEST_SIZE 1024      // request header bytes kept per client
+#define PROM_RESPONSE_SIZE 4096     // one exposition, headers included
+#define PROM_CLIENT_TIMEOUT 5000000 // µs before a stalled client is dropped
+#define PROM_BUCKETS 8              // frame-time histogram bounds
+
+#define PERF_HUD_PERIOD 1000000 // µs between --perf-counters HUD updates
+
+#define TRACE_MAX_EVENTS (1 << 20) // --trace buffer, ~24 min at 60 fps
+#define TRACE_FRAME_EVENTS 20      // worst case recorded in one frame
+#define TRACE_OUT_SIZE 65536       // formatted bytes per write() at most
+
+#define REALTIME_PRIORITY 10 // SCHED_FIFO priority, below kernel threads
+#define REALTIME_BUCKETS 10  // frame-start jitter histogram bounds
+
+#define ONCE_MAX_CELLS 4096        // largest --once frame (stack buffers)
+#define ONCE_FRAME_PERIOD 86400000 // frame counter wrap for --once
 
 #define EXIT_OK 0
 #define EXIT_ERR 1
 #define EXIT_OOM 2
 
 // ════════════════════════════════════════════════════════════════════
-//  Types & Data
+//  Types & Data
+// ════════════════════════════════════════════════════════════════════
+
+// ── Per-wave overrides from --wave ─────────────────────────────────
+enum {
+  SPEC_FREQ = 1 << 0,
+  SPEC_AMP = 1 << 1,
+  SPEC_SPEED = 1 << 2,
+  SPEC_SHAPE = 1 << 3,
+  SPEC_HARM = 1 << 4,
+  SPEC_GLYPH = 1 << 5,
+};
+
+typedef struct {
+  unsigned set; // SPEC_* fields given
+  Wave w;
+} WaveSpec;
+
+typedef struct {
+  double speed_mult;
+  int fps;
+  int num_waves;
+  const char *color_name;
+  const char *glyph;      // NULL = use per-wave defaults
+  const char *audio_path; // NULL = no audio input, "-" = stdin
+  int audio_rate;
+  bool stream;           // plot numbers read from stdin
+  const char *file_path; // NULL = no time-series file
+  int channels;          // interleaved series in a raw --file
+  bool sys;              // drive waves from /proc metrics
+  int sys_interval;      // ms between /proc samples
+  bool pv;               // pass stdin to stdout, draw throughput on tty
+  char **cmd_argv;       // command to wrap in a pty, NULL = none
+  int height;            // render into N lines inline, 0 = full screen
+  bool progress;         // draw a fill level read from progress_fd
+  int progress_fd;
+  bool once;             // print a single wall-clock frame and exit
+  int size_cols;         // --size override, 0 = ask the terminal
+  int size_rows;
+  const char *generator; // column kernel for the built-in waves
+  const char *formula;   // --formula expression, replaces the kernel
+  bool noise;            // --noise simplex waves, replaces the kernel
+  int superpose;         // --superpose display, WAVE_SUPERPOSE_OFF = none
+  bool physics;          // --physics damped-string simulation
+  double impulse_rate;   // random --physics/--ripple impulses per second
+  bool ripple;           // --ripple 2D ripple tank
+  bool ocean;            // --3d perspective ocean
+  int threads;           // --threads rendering --ripple/--3d, 0 = per CPU
+  int foam;              // --foam particle capacity, 0 = no foam
+  int shape;             // --shape for every wave, -1 = sine
+  WaveSpec specs[MAX_WAVE_SPECS]; // --wave overrides for waves 0, 1, ...
+  int num_specs;
+  const char *metrics_path; // --metrics-out JSON lines, NULL = off
+  bool metrics_aggregate;   // one line per second instead of per frame
+  const char *metrics_listen; // --metrics-listen host:port or socket path
+  bool perf_counters;         // --perf-counters hardware counters per stage
+  const char *trace_path;     // --trace Chrome trace-event JSON, NULL = off
+  bool realtime;              // --realtime deadline pacing and jitter stats
+  bool rt_fifo;               // and what it asks of the system
+  bool rt_lock;
+  int rt_cpu; // CPU to pin to, -1 = the one we start on, -2 = no pinning
+} WaveConfig;
+
+// ── Frame stages, timed for --metrics-out ──────────────────────────
+enum {
+  STAGE_CLEAR,
+  STAGE_SIMULATE, // physics string and ripple tank steps
+  STAGE_PLOT,
+  STAGE_ENCODE,
+  STAGE_WRITE,
+  STAGE_COUNT
+};
+
+static const char *const stage_names[STAGE_COUNT] = {
+    "clear", "simulate", "plot", "encode", "write"};
+
+// ── One frame as reported by --metrics-out ─────────────────────────
+typedef struct {
+  uint64_t frame;
+  uint64_t start_us;             // since the first frame
+  uint32_t stage_us[STAGE_COUNT];
+  uint32_t bytes;                // written to the terminal
+  bool missed;                   // work overran the frame interval
+  bool resized;
+  int fps, waves, rows, cols;    // settings in effect
+} FrameRecord;
+
+// ── Metrics writer state (--metrics-out) ───────────────────────────
+typedef struct {
+  int fd;
+  bool aggregate;
+  bool running;
+  pthread_t thread;
+  atomic_size_t head;       // records pushed by the render loop
+  atomic_size_t tail;       // records consumed by the writer
+  _Atomic uint64_t dropped; // records lost to a full ring
+  atomic_bool quit;
+  FrameRecord ring[METRICS_RING_SIZE];
+
+  // Writer thread only
+  char out[METRICS_OUT_SIZE];
+  size_t out_len;
+  FrameRecord window;       // aggregate: last record of the window
+  uint64_t window_start_us; // aggregate: start of the current second
+  uint64_t window_frames, window_bytes, window_missed, window_resizes;
+  uint64_t window_sum[STAGE_COUNT];
+  uint32_t window_max[STAGE_COUNT];
+} MetricsState;
+
+// ── One scrape connection (--metrics-listen) ───────────────────────
+typedef struct {
+  int fd;            // -1 = free slot
+  uint64_t since_us; // accepted at
+  size_t req_len;    // request bytes read so far
+  size_t out_len;    // response bytes prepared, 0 = still reading
+  size_t out_off;    // and already sent
+  char req[PROM_REQUEST_SIZE];
+  char out[PROM_RESPONSE_SIZE];
+} PromClient;
+
+// ── Prometheus endpoint state (--metrics-listen) ───────────────────
+typedef struct {
+  int fd;                // listening socket, -1 = off
+  const char *unix_path; // socket file to remove at exit, NULL = TCP
+  uint32_t stall_us;     // writes slower than this count as stalls
+  int target_fps;
+  uint64_t frames, bytes, stalls, dropped;
+  uint64_t bucket[PROM_BUCKETS + 1]; // per bound, the last one is +Inf
+  uint64_t frame_us_sum;
+  uint64_t fps_start_us, fps_frames; // current one-second fps window
+  double fps;                        // measured over the last window
+  char body[PROM_RESPONSE_SIZE];
+  PromClient clients[PROM_MAX_CLIENTS];
+} PromState;
+
+// ── Hardware counters per stage (--perf-counters) ──────────────────
+enum {
+  HW_CYCLES,
+  HW_INSTRUCTIONS,
+  HW_CACHE_MISSES,
+  HW_BRANCH_MISSES,
+  HW_COUNT,
+};
+
+typedef struct {
+  int fd[HW_COUNT];   // -1 = not counted
+  int slot[HW_COUNT]; // position in a group read, -1 = not counted
+  int leader;         // group leader fd
+  int num_open;       // 0 = off
+  int err;            // why nothing could be opened
+  bool user_only;     // kernel time excluded (perf_event_paranoid)
+  uint64_t last[HW_COUNT];                // at the last stage boundary
+  uint64_t total[STAGE_COUNT][HW_COUNT];  // whole run
+  uint64_t window[STAGE_COUNT][HW_COUNT]; // since the HUD was refreshed
+  uint64_t frames, cells, window_cells;
+  uint64_t window_start_us;
+  char hud[160]; // plain ASCII, one column per byte
+} PerfState;
+
+// ── Trace event names: the stages, then these (--trace) ────────────
+enum {
+  TRACE_FRAME = STAGE_COUNT,
+  TRACE_RESIZE,
+  TRACE_SIGWINCH,
+  TRACE_SIGINT,
+  TRACE_SIGTERM,
+  TRACE_NAMES,
+};
+
+// ── One recorded trace event ───────────────────────────────────────
+typedef struct {
+  uint64_t ts_us; // since the trace started
+  uint32_t frame;
+  uint8_t name;   // STAGE_* or TRACE_*
+  char phase;     // 'B'egin, 'E'nd or 'i'nstant
+} TraceEvent;
+
+// ── Trace buffer state (--trace) ───────────────────────────────────
+typedef struct {
+  int fd; // -1 = off
+  uint64_t epoch_us;
+  TraceEvent *events; // TRACE_MAX_EVENTS, filled in order
+  size_t len;
+  uint32_t frame;          // current frame, for the events' args
+  int open_stage;          // stage begun but not ended, -1 = between frames
+  bool full;               // no room for another whole frame
+  uint64_t frames_dropped; // not recorded once the buffer filled up
+} TraceState;
+
+// ── Real-time mode state (--realtime) ──────────────────────────────
+typedef struct {
+  char granted[256];  // what the system allowed, reported at exit
+  bool locked;        // mlockall() succeeded
+  bool lock_future;   // and covers later allocations too
+  uint64_t next_us;   // scheduled start of the next frame
+  uint64_t frames, overruns;
+  uint64_t hist[REALTIME_BUCKETS + 1]; // the last one is the overflow
+  uint64_t late_sum_us, late_max_us;
+} RealtimeState;
+
+// ── Audio-reactive input state (--audio) ───────────────────────────
+typedef struct {
+  int fd;
+  int rate;
+  int num_bands;
+  int bin_lo[MAX_SERIES];
+  int bin_hi[MAX_SERIES];
+  double peak[MAX_SERIES];
+  double level[MAX_SERIES];
+  double base_amp[MAX_SERIES];
+  double base_freq[MAX_SERIES];
+  atomic_size_t head; // total samples written (monotonic)
+  atomic_bool eof;
+  int16_t ring[AUDIO_RING_SIZE];
+} AudioState;
+
+// ── Live numeric stream state (--stream) ───────────────────────────
+typedef struct {
+  int fd;
+  int num_series;       // widest line seen so far
+  size_t head;          // samples pushed (monotonic)
+  double *ring;         // num_series-major, STREAM_HISTORY per series
+  double last[MAX_SERIES];
+  char buf[STREAM_READ_SIZE];
+  size_t len; // bytes of an incomplete trailing line kept in buf
+  bool eof;
+} StreamState;
+
+// ── Memory-mapped time-series viewer state (--file) ────────────────
+typedef struct {
+  int num_series;
+  size_t num_samples;
+  const float *samples; // interleaved, num_series values per sample
+  void *map;            // raw file mapping (NULL for parsed CSV)
+  size_t map_len;
+  float *decoded; // CSV samples parsed into the raw layout
+  int num_levels; // pyramid levels above the raw samples
+  float *pyr_min[FILE_MAX_LEVELS];
+  float *pyr_max[FILE_MAX_LEVELS];
+  size_t pyr_len[FILE_MAX_LEVELS];
+  double view_start; // first visible sample
+  double view_spp;   // samples per column
+} FileView;
+
+// ── System metrics state (--sys) ───────────────────────────────────
+typedef struct {
+  int fd_stat, fd_net, fd_disk;
+  int interval_ms;
+  int num_cpus;
+  bool primed; // a first sample exists to diff against
+  struct timespec last;
+  uint64_t prev_busy[MAX_SERIES];
+  uint64_t prev_total[MAX_SERIES];
+  uint64_t prev_rx, prev_tx, prev_rd, prev_wr;
+  double peak[SYS_IO_METRICS];
+  double target[MAX_SERIES]; // latest sampled level per wave, [0, 1]
+  double level[MAX_SERIES];  // eased level actually drawn
+  bool disk_line[SYS_MAX_DISK_LINES];
+  char buf[SYS_READ_SIZE];
+} SysState;
+
+// ── Pipe throughput state (--pv) ───────────────────────────────────
+typedef struct {
+  _Atomic uint64_t bytes; // moved so far, written by the pump thread
+  atomic_bool done;
+  bool failed;
+  struct timespec start, last;
+  uint64_t last_bytes;
+  double peak;
+  double avg[MAX_SERIES]; // bytes/s, one averaging window per wave
+} PvState;
+
+// ── Command wrapper state (wave -- cmd) ────────────────────────────
+enum { WRAP_GROUND, WRAP_ESC, WRAP_CSI, WRAP_STR, WRAP_STR_ESC };
+
+typedef struct {
+  int master; // pty master; the child's terminal is the slave side
+  pid_t pid;
+  bool stdin_open;
+  int esc;       // WRAP_* state of the forwarded byte stream
+  int utf8_left; // continuation bytes still expected
+  char buf[WRAP_BUF_SIZE];
+} WrapState;
+
+// ── Progress indicator state (--progress) ──────────────────────────
+typedef struct {
+  int fd;
+  double value; // latest fraction read, [0, 1]
+  double shown; // eased fraction drawn
+  bool eof;
+  char buf[PROGRESS_BUF_SIZE];
+  size_t len; // bytes of an incomplete line kept in buf
+} ProgressState;
+
+// ── Key codes returned by term_read_key() ──────────────────────────
+enum {
+  KEY_NONE = -1,
+  KEY_UP = 0x100,
+  KEY_DOWN,
+  KEY_LEFT,
+  KEY_RIGHT,
+  KEY_HOME,
+  KEY_END,
+  KEY_PGUP,
+  KEY_PGDN,
+  KEY_MOUSE, // SGR mouse report, details in g_mouse
+};
+
+// ── Last mouse report (KEY_MOUSE) ──────────────────────────────────
+typedef struct {
+  int button; // xterm button code: 0-2 press, +32 motion, +64 wheel
+  int x, y;   // 1-based cell
+  bool release;
+} MouseEvent;
+
+// ════════════════════════════════════════════════════════════════════
+//  Globals for signal handlers (minimal — async-signal-safe only)
+// ════════════════════════════════════════════════════════════════════
+
+static volatile sig_atomic_t g_resized = 1; // force initial read
+static volatile sig_atomic_t g_quit = 0;
+static volatile sig_atomic_t g_quit_signal = 0; // SIGINT or SIGTERM seen
+static _Atomic uint64_t g_winch_us = 0;         // when each last arrived
+static _Atomic uint64_t g_quit_us = 0;
+
+// Resources tracked globally so cleanup is centralized
+static char *g_frame_buf = NULL;
+static WaveCtx *g_ctx = NULL;
+static AudioState g_audio;
+static StreamState g_stream;
+static FileView g_file;
+static SysState g_sys;
+static PvState g_pv;
+static WrapState g_wrap;
+static ProgressState g_progress;
+static MetricsState g_metrics = {.fd = -1};
+static PromState g_prom = {.fd = -1};
+static PerfState g_perf;
+static TraceState g_trace = {.fd = -1, .open_stage = -1};
+static RealtimeState g_rt;
+
+// Terminal frames are written to; /dev/tty when stdout carries data
+static int g_out_fd = STDOUT_FILENO;
+
+// Saved terminal input mode, restored on exit
+static struct termios g_saved_tio;
+static bool g_tio_saved = false;
+static bool g_mouse_on = false; // SGR mouse reporting enabled
+static MouseEvent g_mouse;
+
+// ════════════════════════════════════════════════════════════════════
+//  Error handling helpers
+// ════════════════════════════════════════════════════════════════════
+
+__attribute__((format(printf, 1, 2))) static void die(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  fprintf(stderr, "\033[1;31merror:\033[0m ");
+  vfprintf(stderr, fmt, ap);
+  fputc('\n', stderr);
+  va_end(ap);
+  exit(EXIT_ERR);
+}
+
+static void die_oom(const char *context) {
+  fprintf(stderr, "\033[1;31mfatal:\033[0m out of memory (%s)\n", context);
+  exit(EXIT_OOM);
+}
+
+/// Safe malloc wrapper — aborts on allocation failure.
+static void *xmalloc(size_t size) {
+  void *p = malloc(size);
+  if (!p && size > 0)
+    die_oom("malloc");
+  return p;
+}
+
+/// Safe calloc wrapper — aborts on allocation failure.
+static void *xcalloc(size_t count, size_t size) {
+  void *p = calloc(count, size);
+  if (!p && count > 0 && size > 0)
+    die_oom("calloc");
+  return p;
+}
+
+/// Safe realloc wrapper — preserves original pointer on failure.
+static void *xrealloc(void *ptr, size_t size) {
+  void *p = realloc(ptr, size);
+  if (!p && size > 0)
+    die_oom("realloc");
+  return p;
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Signal handlers (async-signal-safe ONLY)
+// ════════════════════════════════════════════════════════════════════
+
+// clock_gettime() is async-signal-safe, so handlers may timestamp too
+static uint64_t mono_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static void handle_sigwinch(int sig) {
+  (void)sig;
+  atomic_store_explicit(&g_winch_us, mono_us(), memory_order_relaxed);
+  g_resized = 1;
+}
+
+static void handle_sigint(int sig) {
+  atomic_store_explicit(&g_quit_us, mono_us(), memory_order_relaxed);
+  g_quit_signal = sig;
+  g_quit = 1;
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Terminal cleanup (called from main, not from signal handler)
+// ════════════════════════════════════════════════════════════════════
+
+static void cleanup_terminal(void) {
+  // Show cursor, reset attributes
+  const char restore[] = "\033[?25h\033[0m\n";
+  if (g_mouse_on) {
+    const char mouse_off[] = "\033[?1006l\033[?1002l";
+    (void)write(g_out_fd, mouse_off, sizeof(mouse_off) - 1);
+    g_mouse_on = false;
+  }
+  (void)write(g_out_fd, restore, sizeof(restore) - 1);
+  if (g_tio_saved) {
+    tcsetattr(STDIN_FILENO, TCSANOW, &g_saved_tio);
+    g_tio_saved = false;
+  }
+}
+
+static void cleanup_resources(void) {
+  free(g_frame_buf);
+  g_frame_buf = NULL;
+  wave_ctx_free(g_ctx);
+  g_ctx = NULL;
+  free(g_stream.ring);
+  g_stream.ring = NULL;
+  for (int i = 0; i < g_file.num_levels; i++) {
+    free(g_file.pyr_min[i]);
+    free(g_file.pyr_max[i]);
+  }
+  g_file.num_levels = 0;
+  free(g_file.decoded);
+  g_file.decoded = NULL;
+  if (g_file.map) {
+    munmap(g_file.map, g_file.map_len);
+    g_file.map = NULL;
+  }
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Terminal helpers
+// ════════════════════════════════════════════════════════════════════
+
+static void term_size(int *rows, int *cols) {
+  struct winsize w;
+  if (ioctl(g_out_fd, TIOCGWINSZ, &w) == 0 && w.ws_row > 0 &&
+      w.ws_col > 0) {
+    *rows = w.ws_row;
+    *cols = w.ws_col;
+  } else {
+    *rows = 24;
+    *cols = 80;
+  }
+}
+
+/// Number of lines a frame covers on a `term_rows` terminal: the
+/// --height region, the strip under a wrapped command, or everything.
+static int region_rows(const WaveConfig *cfg, int term_rows) {
+  int want = cfg->height;
+  if (cfg->cmd_argv) {
+    if (!want)
+      want = WRAP_STRIP_ROWS;
+    if (want > term_rows - 1) // leave the command at least one line
+      want = term_rows - 1;
+  }
+  if (!want || want > term_rows)
+    want = term_rows;
+  return want < 1 ? 1 : want;
+}
+
+/// Emit the escape that moves to the start of region row `row`
+/// (0-based): absolute for the full screen or a wrapped command's strip,
+/// relative to the saved cursor for an inline region.
+static size_t region_cursor(char *buf, size_t cap, int origin_row,
+                            bool inline_mode, int row) {
+  int len;
+  if (inline_mode)
+    len = row > 0 ? snprintf(buf, cap, "\0338\033[%dB", row)
+                  : snprintf(buf, cap, "\0338");
+  else
+    len = snprintf(buf, cap, "\033[%d;1H",
+                   (origin_row ? origin_row : 1) + row);
+  return len > 0 && (size_t)len < cap ? (size_t)len : 0;
+}
+
+/// Switch stdin to unbuffered, no-echo input so single key presses can
+/// be read. Signals (Ctrl+C) keep working. Restored by cleanup_terminal.
+static void term_raw_input(void) {
+  if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &g_saved_tio) != 0)
+    return;
+  struct termios tio = g_saved_tio;
+  tio.c_lflag &= ~(tcflag_t)(ICANON | ECHO);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  if (tcsetattr(STDIN_FILENO, TCSANOW, &tio) == 0)
+    g_tio_saved = true;
+}
+
+/// Report button presses and drags as SGR mouse sequences. Turned off
+/// again by cleanup_terminal.
+static void term_mouse_on(void) {
+  const char mouse_on[] = "\033[?1002h\033[?1006h";
+  (void)write(g_out_fd, mouse_on, sizeof(mouse_on) - 1);
+  g_mouse_on = true;
+}
+
+static bool read_byte_now(unsigned char *c) {
+  struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+  return poll(&pfd, 1, 0) > 0 && read(STDIN_FILENO, c, 1) == 1;
+}
+
+/// Parse the rest of an SGR mouse report, "b;x;y" then M (press/motion)
+/// or m (release), into g_mouse. Returns KEY_MOUSE, or KEY_NONE if the
+/// sequence is malformed.
+static int term_read_mouse(void) {
+  int field[3] = {0, 0, 0};
+  unsigned char c;
+  for (int i = 0; i < 3;) {
+    if (!read_byte_now(&c))
+      return KEY_NONE;
+    if (c >= '0' && c <= '9' && field[i] < 100000)
+      field[i] = field[i] * 10 + (c - '0');
+    else if (c == ';' && i < 2)
+      i++;
+    else if ((c == 'M' || c == 'm') && i == 2)
+      break;
+    else
+      return KEY_NONE;
+  }
+  g_mouse.button = field[0];
+  g_mouse.x = field[1];
+  g_mouse.y = field[2];
+  g_mouse.release = c == 'm';
+  return KEY_MOUSE;
+}
+
+/// Read one key press without blocking. Returns KEY_NONE if nothing is
+/// pending, a byte for plain keys, or a KEY_* code for escape sequences.
+/// Mouse reports come back as KEY_MOUSE with g_mouse filled in.
+static int term_read_key(void) {
+  unsigned char c;
+  if (!read_byte_now(&c))
+    return KEY_NONE;
+  if (c != 0x1b)
+    return c;
+
+  unsigned char seq[3];
+  if (!read_byte_now(&seq[0]) || (seq[0] != '[' && seq[0] != 'O'))
+    return 0x1b;
+  if (!read_byte_now(&seq[1]))
+    return 0x1b;
+  if (seq[0] == '[' && seq[1] == '<')
+    return term_read_mouse();
+  switch (seq[1]) {
+  case 'A':
+    return KEY_UP;
+  case 'B':
+    return KEY_DOWN;
+  case 'C':
+    return KEY_RIGHT;
+  case 'D':
+    return KEY_LEFT;
+  case 'H':
+    return KEY_HOME;
+  case 'F':
+    return KEY_END;
+  default:
+    break;
+  }
+  if (seq[1] >= '0' && seq[1] <= '9' && read_byte_now(&seq[2]) &&
+      seq[2] == '~') {
+    switch (seq[1]) {
+    case '1':
+    case '7':
+      return KEY_HOME;
+    case '4':
+    case '8':
+      return KEY_END;
+    case '5':
+      return KEY_PGUP;
+    case '6':
+      return KEY_PGDN;
+    default:
+      break;
+    }
+  }
+  return KEY_NONE;
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Audio-reactive input (--audio)
+// ════════════════════════════════════════════════════════════════════
+//
+// A reader thread pulls raw S16LE mono PCM into a single-producer /
+// single-consumer ring. Each frame the render loop snapshots the newest
+// AUDIO_FFT_SIZE samples, runs a radix-2 FFT and maps log-spaced bands
+// onto the waves. The render loop never waits on the reader: it only
+// loads the ring head, and every buffer involved is static.
+
+
+static float g_fft_re[AUDIO_FFT_SIZE];
+static float g_fft_im[AUDIO_FFT_SIZE];
+static float g_fft_cos[AUDIO_FFT_SIZE / 2];
+static float g_fft_sin[AUDIO_FFT_SIZE / 2];
+static float g_fft_window[AUDIO_FFT_SIZE];
+static uint16_t g_fft_rev[AUDIO_FFT_SIZE];
+
+/// Precompute twiddles, the Hann window and the bit-reversal permutation.
+static void fft_init(void) {
+  for (int i = 0; i < AUDIO_FFT_SIZE / 2; i++) {
+    g_fft_cos[i] = (float)cos(TWO_PI * i / AUDIO_FFT_SIZE);
+    g_fft_sin[i] = (float)sin(TWO_PI * i / AUDIO_FFT_SIZE);
+  }
+  for (int i = 0; i < AUDIO_FFT_SIZE; i++) {
+    g_fft_window[i] =
+        (float)(0.5 - 0.5 * cos(TWO_PI * i / (AUDIO_FFT_SIZE - 1)));
+    unsigned r = 0;
+    for (int b = 0; b < AUDIO_FFT_LOG2; b++)
+      r |= (((unsigned)i >> b) & 1u) << (AUDIO_FFT_LOG2 - 1 - b);
+    g_fft_rev[i] = (uint16_t)r;
+  }
+}
+
+/// In-place iterative radix-2 decimation-in-time FFT over g_fft_re/im.
+static void fft_run(void) {
+  for (int i = 0; i < AUDIO_FFT_SIZE; i++) {
+    int j = g_fft_rev[i];
+    if (j > i) {
+      float tr = g_fft_re[i];
+      g_fft_re[i] = g_fft_re[j];
+      g_fft_re[j] = tr;
+      float ti = g_fft_im[i];
+      g_fft_im[i] = g_fft_im[j];
+      g_fft_im[j] = ti;
+    }
+  }
+  for (int len = 2; len <= AUDIO_FFT_SIZE; len <<= 1) {
+    int half = len >> 1;
+    int step = AUDIO_FFT_SIZE / len;
+    for (int i = 0; i < AUDIO_FFT_SIZE; i += len) {
+      for (int k = 0; k < half; k++) {
+        float wr = g_fft_cos[k * step];
+        float wi = -g_fft_sin[k * step];
+        int a = i + k, b = a + half;
+        float xr = g_fft_re[b] * wr - g_fft_im[b] * wi;
+        float xi = g_fft_re[b] * wi + g_fft_im[b] * wr;
+        g_fft_re[b] = g_fft_re[a] - xr;
+        g_fft_im[b] = g_fft_im[a] - xi;
+        g_fft_re[a] += xr;
+        g_fft_im[a] += xi;
+      }
+    }
+  }
+}
+
+/// Reader thread: blocking reads straight into the ring, then publish.
+/// Regular files are paced to the sample rate so they play in real time;
+/// pipes and FIFOs are paced by their producer.
+static void *audio_reader(void *arg) {
+  AudioState *as = arg;
+  int16_t chunk[AUDIO_READ_CHUNK];
+  size_t carry = 0; // odd byte left over from the previous read
+  struct stat st;
+  bool paced = fstat(as->fd, &st) == 0 && S_ISREG(st.st_mode);
+  struct timespec t0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (;;) {
+    ssize_t n = read(as->fd, (char *)chunk + carry, sizeof(chunk) - carry);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    size_t bytes = carry + (size_t)n;
+    size_t count = bytes / sizeof(int16_t);
+    size_t head = atomic_load_explicit(&as->head, memory_order_relaxed);
+    for (size_t i = 0; i < count; i++)
+      as->ring[(head + i) & (AUDIO_RING_SIZE - 1)] = chunk[i];
+    atomic_store_explicit(&as->head, head + count, memory_order_release);
+    carry = bytes - count * sizeof(int16_t);
+    if (carry)
+      memmove(chunk, (char *)chunk + count * sizeof(int16_t), carry);
+
+    if (paced) {
+      double due = (double)(head + count) / as->rate;
+      struct timespec ts = {
+          .tv_sec = t0.tv_sec + (time_t)due,
+          .tv_nsec = t0.tv_nsec + (long)((due - (double)(time_t)due) * 1e9),
+      };
+      if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+      }
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+             EINTR)
+        ;
+    }
+  }
+  atomic_store_explicit(&as->eof, true, memory_order_release);
+  return NULL;
+}
+
+/// Open the PCM source, split the spectrum into one band per wave and
+/// start the reader thread. Base wave parameters are captured so the
+/// per-frame modulation never drifts.
+static void audio_start(const char *path, int rate, const Wave *waves,
+                        int n) {
+  AudioState *as = &g_audio;
+  as->fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+  if (as->fd < 0)
+    die("cannot open audio source '%s': %s", path, strerror(errno));
+  as->rate = rate;
+  as->num_bands = n;
+  atomic_init(&as->head, 0);
+  atomic_init(&as->eof, false);
+  fft_init();
+
+  double max_hz = rate / 2.0;
+  int prev_hi = 1;
+  for (int i = 0; i < n; i++) {
+    double lo_hz = AUDIO_MIN_HZ * pow(max_hz / AUDIO_MIN_HZ, (double)i / n);
+    double hi_hz =
+        AUDIO_MIN_HZ * pow(max_hz / AUDIO_MIN_HZ, (double)(i + 1) / n);
+    int lo = (int)(lo_hz * AUDIO_FFT_SIZE / rate);
+    int hi = (int)(hi_hz * AUDIO_FFT_SIZE / rate);
+    if (lo < prev_hi)
+      lo = prev_hi;
+    if (hi <= lo)
+      hi = lo + 1;
+    if (hi > AUDIO_FFT_SIZE / 2)
+      hi = AUDIO_FFT_SIZE / 2;
+    if (lo >= hi)
+      lo = hi - 1;
+    as->bin_lo[i] = lo;
+    as->bin_hi[i] = hi;
+    prev_hi = hi;
+    as->peak[i] = AUDIO_NOISE_FLOOR;
+    as->level[i] = 0.0;
+    as->base_amp[i] = waves[i].amp;
+    as->base_freq[i] = waves[i].freq;
+  }
+
+  pthread_t tid;
+  if (pthread_create(&tid, NULL, audio_reader, as) != 0)
+    die("cannot start audio reader thread");
+  pthread_detach(tid);
+}
+
+/// Analyse the newest window and drive each wave from its band level.
+/// Returns false once the source is exhausted.
+static bool audio_update(Wave *waves, int n) {
+  AudioState *as = &g_audio;
+  size_t head = atomic_load_explicit(&as->head, memory_order_acquire);
+  bool eof = atomic_load_explicit(&as->eof, memory_order_acquire);
+
+  size_t start = head - AUDIO_FFT_SIZE;
+  for (int i = 0; i < AUDIO_FFT_SIZE; i++) {
+    float s = head < AUDIO_FFT_SIZE
+                  ? 0.0f
+                  : as->ring[(start + (size_t)i) & (AUDIO_RING_SIZE - 1)];
+    g_fft_re[i] = s * (1.0f / 32768.0f) * g_fft_window[i];
+    g_fft_im[i] = 0.0f;
+  }
+  // If the writer lapped us mid-copy the window is torn; keep last levels
+  size_t after = atomic_load_explicit(&as->head, memory_order_acquire);
+  if (after - head > AUDIO_RING_SIZE - AUDIO_FFT_SIZE)
+    return !eof;
+
+  fft_run();
+
+  for (int w = 0; w < n && w < as->num_bands; w++) {
+    double energy = 0.0;
+    for (int k = as->bin_lo[w]; k < as->bin_hi[w]; k++)
+      energy += g_fft_re[k] * g_fft_re[k] + g_fft_im[k] * g_fft_im[k];
+    energy = sqrt(energy / (as->bin_hi[w] - as->bin_lo[w]));
+
+    as->peak[w] *= AUDIO_PEAK_DECAY;
+    if (as->peak[w] < energy)
+      as->peak[w] = energy;
+    if (as->peak[w] < AUDIO_NOISE_FLOOR)
+      as->peak[w] = AUDIO_NOISE_FLOOR;
+
+    double target = energy / as->peak[w];
+    double k = target > as->level[w] ? AUDIO_ATTACK : AUDIO_RELEASE;
+    as->level[w] += (target - as->level[w]) * k;
+
+    waves[w].amp = as->base_amp[w] * (0.08 + 0.92 * as->level[w]);
+    waves[w].freq = as->base_freq[w] * (1.0 + 0.6 * as->level[w]);
+  }
+  return !eof;
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Live numeric stream (--stream)
+// ════════════════════════════════════════════════════════════════════
+//
+// Every input line is one sample; its first N numbers feed series 0..N-1.
+// Input is drained with large read()s and tokenized in place — no stdio
+// line buffering. All series share one write index into a circular
+// history, so scrolling the graph is a head increment, never a memmove.
+
+
+static const double pow10_tab[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                   1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                   1e18, 1e19, 1e20, 1e21, 1e22};
+
+static double scale_pow10(double v, int e) {
+  if (e >= 0)
+    return e <= 22 ? v * pow10_tab[e] : v * pow(10.0, e);
+  return e >= -22 ? v / pow10_tab[-e] : v * pow(10.0, e);
+}
+
+/// Parse a whole token as a decimal number without locale or errno.
+/// Returns false if any byte of [p, end) is not part of the number.
+static bool scan_number(const char *p, const char *end, double *out) {
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    neg = *p++ == '-';
+
+  uint64_t mant = 0;
+  int digits = 0, exp10 = 0;
+  bool any = false;
+  for (; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+    if (digits < 19) {
+      mant = mant * 10 + (uint64_t)(*p - '0');
+      if (mant)
+        digits++;
+    } else {
+      exp10++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+      if (digits < 19) {
+        mant = mant * 10 + (uint64_t)(*p - '0');
+        if (mant)
+          digits++;
+        exp10--;
+      }
+    }
+  }
+  if (!any)
+    return false;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    bool eneg = false;
+    int e = 0;
+    p++;
+    if (p < end && (*p == '-' || *p == '+'))
+      eneg = *p++ == '-';
+    if (p >= end || *p < '0' || *p > '9')
+      return false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+      if (e < 10000)
+        e = e * 10 + (*p - '0');
+    exp10 += eneg ? -e : e;
+  }
+  if (p != end)
+    return false;
+
+  double v = scale_pow10((double)mant, exp10);
+  *out = neg ? -v : v;
+  return true;
+}
+
+static void stream_start(int fd) {
+  StreamState *st = &g_stream;
+  st->fd = fd;
+  st->ring = xcalloc((size_t)MAX_SERIES * STREAM_HISTORY, sizeof(double));
+}
+
+/// Split a line on blanks, commas and semicolons and parse up to `max`
+/// numeric tokens into out[]. Non-numeric tokens are skipped.
+static int scan_line(const char *p, const char *end, double *out, int max) {
+  int n = 0;
+  while (p < end && n < max) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == ',' || *p == ';' ||
+                       *p == '\r'))
+      p++;
+    const char *tok = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != ',' && *p != ';' &&
+           *p != '\r')
+      p++;
+    if (p > tok && scan_number(tok, p, &out[n]))
+      n++;
+  }
+  return n;
+}
+
+/// Tokenize one line and push it as the next sample of every series.
+/// Series missing from a short line repeat their previous value.
+static void stream_push_line(StreamState *st, const char *p,
+                             const char *end) {
+  int n = scan_line(p, end, st->last, MAX_SERIES);
+  if (n == 0)
+    return;
+  if (n > st->num_series) {
+    // A newly appearing series starts flat at its first value
+    for (int s = st->num_series; s < n; s++)
+      for (size_t i = 0; i < STREAM_HISTORY; i++)
+        st->ring[(size_t)s * STREAM_HISTORY + i] = st->last[s];
+    st->num_series = n;
+  }
+  size_t slot = st->head & (STREAM_HISTORY - 1);
+  for (int s = 0; s < st->num_series; s++)
+    st->ring[(size_t)s * STREAM_HISTORY + slot] = st->last[s];
+  st->head++;
+}
+
+/// Drain whatever input is ready without blocking the render loop.
+static void stream_poll(StreamState *st) {
+  for (int reads = 0; !st->eof && reads < STREAM_MAX_READS; reads++) {
+    struct pollfd pfd = {.fd = st->fd, .events = POLLIN};
+    if (poll(&pfd, 1, 0) <= 0)
+      return;
+    ssize_t n = read(st->fd, st->buf + st->len, sizeof(st->buf) - st->len);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+      return;
+    if (n <= 0) {
+      st->eof = true;
+      if (st->len)
+        stream_push_line(st, st->buf, st->buf + st->len);
+      st->len = 0;
+      return;
+    }
+
+    const char *p = st->buf;
+    const char *end = st->buf + st->len + (size_t)n;
+    for (;;) {
+      const char *nl = memchr(p, '\n', (size_t)(end - p));
+      if (!nl)
+        break;
+      stream_push_line(st, p, nl);
+      p = nl + 1;
+    }
+    st->len = (size_t)(end - p);
+    if (st->len == sizeof(st->buf)) // absurdly long line — drop it
+      st->len = 0;
+    else if (st->len)
+      memmove(st->buf, p, st->len);
+  }
+}
+
+/// Samples shown across `cols` columns: no more than have arrived and
+/// no more than the ring still holds.
+static size_t stream_visible(const StreamState *st, int cols) {
+  size_t count = st->head < (size_t)cols ? st->head : (size_t)cols;
+  return count < STREAM_HISTORY ? count : STREAM_HISTORY;
+}
+
+/// Find the shared vertical range of the samples visible in `cols`.
+static void stream_range(const StreamState *st, int cols, double *lo,
+                         double *hi) {
+  size_t count = stream_visible(st, cols);
+  *lo = INFINITY;
+  *hi = -INFINITY;
+  for (int s = 0; s < st->num_series; s++) {
+    const double *ring = st->ring + (size_t)s * STREAM_HISTORY;
+    for (size_t i = st->head - count; i < st->head; i++) {
+      double v = ring[i & (STREAM_HISTORY - 1)];
+      if (v < *lo)
+        *lo = v;
+      if (v > *hi)
+        *hi = v;
+    }
+  }
+}
+
+/// Fill ys with series `s`, newest sample in the rightmost column and
+/// larger values towards the top. Columns without history are gaps.
+static void stream_column(const StreamState *st, int s, int cols, double lo,
+                          double hi, double *ys) {
+  const double *ring = st->ring + (size_t)s * STREAM_HISTORY;
+  double span = hi > lo ? hi - lo : 1.0;
+  size_t count = stream_visible(st, cols);
+  int x0 = cols - (int)count;
+  for (int x = 0; x < x0; x++)
+    ys[x] = NAN;
+  size_t i = st->head - count;
+  for (int x = x0; x < cols; x++, i++)
+    ys[x] = 1.0 - 2.0 * (ring[i & (STREAM_HISTORY - 1)] - lo) / span;
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Memory-mapped time-series viewer (--file)
+// ════════════════════════════════════════════════════════════════════
+//
+// Raw files are native-endian float32, `--channels` series interleaved,
+// and are read straight from the mapping. CSV files are parsed once into
+// the same layout. A min/max pyramid (block size FILE_FANOUT^k at level
+// k) is built in one pass, after which any column range is answered
+// from at most ~2 * FILE_FANOUT blocks per level, whatever the zoom.
+
+static bool has_suffix(const char *s, const char *suffix) {
+  size_t n = strlen(s), m = strlen(suffix);
+  return n >= m && strcasecmp(s + n - m, suffix) == 0;
+}
+
+/// Parse a mapped CSV into an interleaved float array. Lines without any
+/// number (headers, comments) are skipped.
+static void file_parse_csv(FileView *fv, const char *p, const char *end) {
+  size_t cap = 0, n = 0;
+  double vals[MAX_SERIES];
+  double last[MAX_SERIES] = {0};
+  while (p < end) {
+    const char *nl = memchr(p, '\n', (size_t)(end - p));
+    const char *eol = nl ? nl : end;
+    int k = scan_line(p, eol, vals, MAX_SERIES);
+    p = nl ? nl + 1 : end;
+    if (k == 0)
+      continue;
+    if (fv->num_series == 0)
+      fv->num_series = k;
+    for (int s = 0; s < k && s < fv->num_series; s++)
+      last[s] = vals[s];
+    if (n == cap) {
+      cap = cap ? cap * 2 : 4096;
+      fv->decoded = xrealloc(fv->decoded, cap * (size_t)fv->num_series *
+                                              sizeof(float));
+    }
+    for (int s = 0; s < fv->num_series; s++)
+      fv->decoded[n * (size_t)fv->num_series + (size_t)s] = (float)last[s];
+    n++;
+  }
+  fv->samples = fv->decoded;
+  fv->num_samples = n;
+}
+
+/// Build pyramid level `lv` from the level below it (or the raw samples).
+static void file_build_level(FileView *fv, int lv) {
+  const size_t ns = (size_t)fv->num_series;
+  size_t below = lv == 1 ? fv->num_samples : fv->pyr_len[lv - 2];
+  size_t len = (below + FILE_FANOUT - 1) / FILE_FANOUT;
+  float *mn = xmalloc(len * ns * sizeof(float));
+  float *mx = xmalloc(len * ns * sizeof(float));
+  const float *src_mn = lv == 1 ? fv->samples : fv->pyr_min[lv - 2];
+  const float *src_mx = lv == 1 ? fv->samples : fv->pyr_max[lv - 2];
+
+  for (size_t b = 0; b < len; b++) {
+    size_t i0 = b * FILE_FANOUT;
+    size_t i1 = i0 + FILE_FANOUT < below ? i0 + FILE_FANOUT : below;
+    for (size_t s = 0; s < ns; s++) {
+      float lo = src_mn[i0 * ns + s], hi = src_mx[i0 * ns + s];
+      for (size_t i = i0 + 1; i < i1; i++) {
+        float a = src_mn[i * ns + s], c = src_mx[i * ns + s];
+        lo = a < lo ? a : lo;
+        hi = c > hi ? c : hi;
+      }
+      mn[b * ns + s] = lo;
+      mx[b * ns + s] = hi;
+    }
+  }
+  fv->pyr_min[lv - 1] = mn;
+  fv->pyr_max[lv - 1] = mx;
+  fv->pyr_len[lv - 1] = len;
+  fv->num_levels = lv;
+}
+
+static void file_open(FileView *fv, const char *path, int channels) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    die("cannot open '%s': %s", path, strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    die("'%s' is empty or unreadable", path);
+  fv->map_len = (size_t)st.st_size;
+  fv->map = mmap(NULL, fv->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (fv->map == MAP_FAILED) {
+    fv->map = NULL;
+    die("cannot map '%s': %s", path, strerror(errno));
+  }
+  madvise(fv->map, fv->map_len, MADV_SEQUENTIAL);
+
+  if (has_suffix(path, ".csv") || has_suffix(path, ".txt")) {
+    file_parse_csv(fv, fv->map, (const char *)fv->map + fv->map_len);
+    munmap(fv->map, fv->map_len);
+    fv->map = NULL;
+  } else {
+    fv->num_series = channels;
+    fv->samples = fv->map;
+    fv->num_samples = fv->map_len / (sizeof(float) * (size_t)channels);
+  }
+  if (fv->num_samples == 0 || fv->num_series == 0)
+    die("'%s' contains no samples", path);
+
+  size_t remaining = fv->num_samples;
+  for (int lv = 1; lv <= FILE_MAX_LEVELS && remaining > 1; lv++) {
+    file_build_level(fv, lv);
+    remaining = fv->pyr_len[lv - 1];
+  }
+  if (fv->map)
+    madvise(fv->map, fv->map_len, MADV_RANDOM);
+
+  fv->view_start = 0.0;
+  fv->view_spp = 0.0; // fit to width on first frame
+}
+
+/// Exact min/max of series `s` over samples [a, b): greedily take the
+/// largest aligned pyramid block that fits, so each query touches
+/// O(FILE_FANOUT * levels) entries.
+static void file_query(const FileView *fv, int s, size_t a, size_t b,
+                       float *lo, float *hi) {
+  const size_t ns = (size_t)fv->num_series;
+  float mn = INFINITY, mx = -INFINITY;
+  while (a < b) {
+    int lv = 0;
+    size_t bs = 1;
+    while (lv < fv->num_levels && a % (bs * FILE_FANOUT) == 0 &&
+           a + bs * FILE_FANOUT <= b) {
+      bs *= FILE_FANOUT;
+      lv++;
+    }
+    float l, h;
+    if (lv == 0) {
+      l = h = fv->samples[a * ns + (size_t)s];
+    } else {
+      size_t blk = a / bs;
+      l = fv->pyr_min[lv - 1][blk * ns + (size_t)s];
+      h = fv->pyr_max[lv - 1][blk * ns + (size_t)s];
+    }
+    mn = l < mn ? l : mn;
+    mx = h > mx ? h : mx;
+    a += bs;
+  }
+  *lo = mn;
+  *hi = mx;
+}
+
+/// Keep the view inside the data and the zoom within sane limits.
+static void file_clamp_view(FileView *fv, int cols) {
+  double max_spp = (double)fv->num_samples / cols;
+  if (max_spp < FILE_MIN_SPP)
+    max_spp = FILE_MIN_SPP;
+  if (fv->view_spp <= 0.0 || fv->view_spp > max_spp)
+    fv->view_spp = max_spp;
+  if (fv->view_spp < FILE_MIN_SPP)
+    fv->view_spp = FILE_MIN_SPP;
+  double max_start = (double)fv->num_samples - fv->view_spp * cols;
+  if (fv->view_start > max_start)
+    fv->view_start = max_start;
+  if (fv->view_start < 0.0)
+    fv->view_start = 0.0;
+}
+
+/// Apply one key press to the view. Returns false on quit.
+static bool file_handle_key(FileView *fv, int key, int cols) {
+  double width = fv->view_spp * cols;
+  double center = fv->view_start + width / 2.0;
+  switch (key) {
+  case 'q':
+  case 'Q':
+    return false;
+  case 'h':
+  case KEY_LEFT:
+    fv->view_start -= width / 8.0;
+    break;
+  case 'l':
+  case KEY_RIGHT:
+    fv->view_start += width / 8.0;
+    break;
+  case 'H':
+  case KEY_PGUP:
+    fv->view_start -= width;
+    break;
+  case 'L':
+  case KEY_PGDN:
+    fv->view_start += width;
+    break;
+  case '+':
+  case '=':
+  case 'k':
+  case KEY_UP:
+    fv->view_spp /= 2.0;
+    if (fv->view_spp < FILE_MIN_SPP)
+      fv->view_spp = FILE_MIN_SPP;
+    fv->view_start = center - fv->view_spp * cols / 2.0;
+    break;
+  case '-':
+  case 'j':
+  case KEY_DOWN:
+    fv->view_spp *= 2.0;
+    fv->view_start = center - fv->view_spp * cols / 2.0;
+    break;
+  case 'g':
+  case KEY_HOME:
+    fv->view_start = 0.0;
+    break;
+  case 'G':
+  case KEY_END:
+    fv->view_start = (double)fv->num_samples;
+    break;
+  case '0':
+    fv->view_spp = 0.0;
+    break;
+  default:
+    break;
+  }
+  file_clamp_view(fv, cols);
+  return true;
+}
+
+/// Decimate the current view of every series into per-column min/max
+/// spans, scaled to the shared visible range (larger values on top).
+/// lo/hi hold num_series * cols entries.
+static void file_columns(const FileView *fv, int cols, double *lo,
+                         double *hi) {
+  float vmin = INFINITY, vmax = -INFINITY;
+  for (int s = 0; s < fv->num_series; s++) {
+    for (int x = 0; x < cols; x++) {
+      size_t a = (size_t)(fv->view_start + fv->view_spp * x);
+      size_t b = (size_t)(fv->view_start + fv->view_spp * (x + 1));
+      if (b <= a)
+        b = a + 1;
+      if (b > fv->num_samples)
+        b = fv->num_samples;
+      size_t i = (size_t)s * (size_t)cols + (size_t)x;
+      if (a >= b) {
+        lo[i] = hi[i] = NAN;
+        continue;
+      }
+      float l, h;
+      file_query(fv, s, a, b, &l, &h);
+      lo[i] = l;
+      hi[i] = h;
+      vmin = l < vmin ? l : vmin;
+      vmax = h > vmax ? h : vmax;
+    }
+  }
+  double span = vmax > vmin ? (double)vmax - vmin : 1.0;
+  for (size_t i = 0; i < (size_t)fv->num_series * (size_t)cols; i++) {
+    lo[i] = 1.0 - 2.0 * (lo[i] - vmin) / span;
+    hi[i] = 1.0 - 2.0 * (hi[i] - vmin) / span;
+  }
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  System metrics from /proc (--sys)
+// ════════════════════════════════════════════════════════════════════
+//
+// One wave per metric: every CPU core, then network rx/tx and disk
+// read/write. The /proc files stay open and are re-read with pread() at
+// offset 0 into a static buffer, parsed in place. Sampling runs on its
+// own clock; between samples the waves only glide toward their targets.
+
+/// Skip to the start of the next line. Returns end if there is none.
+static const char *next_line(const char *p, const char *end) {
+  const char *nl = memchr(p, '\n', (size_t)(end - p));
+  return nl ? nl + 1 : end;
+}
+
+static const char *skip_blanks(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+  return p;
+}
+
+/// Parse an unsigned decimal field, skipping leading blanks.
+static uint64_t scan_u64(const char **pp, const char *end) {
+  const char *p = skip_blanks(*pp, end);
+  uint64_t v = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+    v = v * 10 + (uint64_t)(*p - '0');
+  *pp = p;
+  return v;
+}
+
+/// Read a whole /proc file into the shared buffer. Returns its length.
+static size_t sys_read(SysState *ss, int fd) {
+  ssize_t n = pread(fd, ss->buf, sizeof(ss->buf) - 1, 0);
+  return n > 0 ? (size_t)n : 0;
+}
+
+static int sys_open(const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    die("cannot open %s: %s", path, strerror(errno));
+  return fd;
+}
+
+/// True for whole disks (not partitions, loop or ram devices), decided
+/// once at startup by probing /sys/block.
+static bool sys_is_disk(const char *name, size_t len) {
+  if ((len >= 4 && memcmp(name, "loop", 4) == 0) ||
+      (len >= 3 && memcmp(name, "ram", 3) == 0) ||
+      (len >= 4 && memcmp(name, "zram", 4) == 0))
+    return false;
+  char path[96];
+  snprintf(path, sizeof(path), "/sys/block/%.*s", (int)len, name);
+  return access(path, F_OK) == 0;
+}
+
+/// Parse per-core busy and total jiffies from /proc/stat.
+static int sys_sample_cpu(SysState *ss, uint64_t *busy, uint64_t *total) {
+  size_t len = sys_read(ss, ss->fd_stat);
+  const char *p = ss->buf, *end = ss->buf + len;
+  int n = 0;
+  for (; p < end && n < ss->num_cpus; p = next_line(p, end)) {
+    if (end - p < 4 || memcmp(p, "cpu", 3) != 0)
+      continue;
+    if (p[3] < '0' || p[3] > '9') // aggregate "cpu " line
+      continue;
+    p += 3;
+    (void)scan_u64(&p, end); // core index
+    uint64_t f[8] = {0};
+    for (int i = 0; i < 8; i++)
+      f[i] = scan_u64(&p, end);
+    uint64_t idle = f[3] + f[4]; // idle + iowait
+    total[n] = f[0] + f[1] + f[2] + f[3] + f[4] + f[5] + f[6] + f[7];
+    busy[n] = total[n] - idle;
+    n++;
+  }
+  return n;
+}
+
+/// Sum rx/tx bytes over every interface except loopback.
+static void sys_sample_net(SysState *ss, uint64_t *rx, uint64_t *tx) {
+  size_t len = sys_read(ss, ss->fd_net);
+  const char *p = ss->buf, *end = ss->buf + len;
+  *rx = *tx = 0;
+  p = next_line(next_line(p, end), end); // two header lines
+  for (; p < end; p = next_line(p, end)) {
+    const char *name = skip_blanks(p, end);
+    const char *colon = memchr(name, ':', (size_t)(end - name));
+    if (!colon)
+      break;
+    if (colon - name == 2 && memcmp(name, "lo", 2) == 0)
+      continue;
+    const char *q = colon + 1;
+    *rx += scan_u64(&q, end);
+    for (int i = 0; i < 7; i++)
+      (void)scan_u64(&q, end);
+    *tx += scan_u64(&q, end);
+  }
+}
+
+/// Sum bytes read/written over whole disks.
+static void sys_sample_disk(SysState *ss, uint64_t *rd, uint64_t *wr) {
+  size_t len = sys_read(ss, ss->fd_disk);
+  const char *p = ss->buf, *end = ss->buf + len;
+  *rd = *wr = 0;
+  for (int line = 0; p < end && line < SYS_MAX_DISK_LINES;
+       p = next_line(p, end), line++) {
+    if (!ss->disk_line[line])
+      continue;
+    const char *q = p;
+    (void)scan_u64(&q, end); // major
+    (void)scan_u64(&q, end); // minor
+    q = skip_blanks(q, end);
+    while (q < end && *q != ' ')
+      q++;
+    uint64_t f[7];
+    for (int i = 0; i < 7; i++)
+      f[i] = scan_u64(&q, end);
+    *rd += f[2] * 512; // sectors read
+    *wr += f[6] * 512; // sectors written
+  }
+}
+
+/// Scale a byte rate against a slowly decaying peak into [0, 1].
+static double sys_rate_level(double *peak, uint64_t now, uint64_t prev,
+                             double secs) {
+  double rate = now >= prev ? (double)(now - prev) / secs : 0.0;
+  *peak *= SYS_PEAK_DECAY;
+  if (*peak < rate)
+    *peak = rate;
+  if (*peak < SYS_RATE_FLOOR)
+    *peak = SYS_RATE_FLOOR;
+  return rate / *peak;
+}
+
+static double elapsed_sec(const struct timespec *a, const struct timespec *b) {
+  return (double)(b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) * 1e-9;
+}
+
+/// Take one sample of every metric and update the per-wave targets.
+static void sys_sample(SysState *ss, const struct timespec *now) {
+  uint64_t busy[MAX_SERIES], total[MAX_SERIES], rx, tx, rd, wr;
+  int n = sys_sample_cpu(ss, busy, total);
+  sys_sample_net(ss, &rx, &tx);
+  sys_sample_disk(ss, &rd, &wr);
+
+  double secs = elapsed_sec(&ss->last, now);
+  if (ss->primed && secs > 0.0) {
+    for (int c = 0; c < n; c++) {
+      uint64_t dt = total[c] - ss->prev_total[c];
+      uint64_t db = busy[c] - ss->prev_busy[c];
+      ss->target[c] = dt ? (double)db / (double)dt : 0.0;
+    }
+    int m = ss->num_cpus;
+    ss->target[m + 0] = sys_rate_level(&ss->peak[0], rx, ss->prev_rx, secs);
+    ss->target[m + 1] = sys_rate_level(&ss->peak[1], tx, ss->prev_tx, secs);
+    ss->target[m + 2] = sys_rate_level(&ss->peak[2], rd, ss->prev_rd, secs);
+    ss->target[m + 3] = sys_rate_level(&ss->peak[3], wr, ss->prev_wr, secs);
+  }
+  memcpy(ss->prev_busy, busy, sizeof(busy[0]) * (size_t)n);
+  memcpy(ss->prev_total, total, sizeof(total[0]) * (size_t)n);
+  ss->prev_rx = rx;
+  ss->prev_tx = tx;
+  ss->prev_rd = rd;
+  ss->prev_wr = wr;
+  ss->last = *now;
+  ss->primed = true;
+}
+
+/// Open the /proc sources and count the metrics. Returns the number of
+/// waves needed (cores + 4).
+static int sys_start(SysState *ss, int interval_ms) {
+  ss->fd_stat = sys_open("/proc/stat");
+  ss->fd_net = sys_open("/proc/net/dev");
+  ss->fd_disk = sys_open("/proc/diskstats");
+  ss->interval_ms = interval_ms;
+
+  // Count cores, capped so the four I/O metrics always fit
+  ss->num_cpus = MAX_SERIES - SYS_IO_METRICS;
+  uint64_t busy[MAX_SERIES], total[MAX_SERIES];
+  ss->num_cpus = sys_sample_cpu(ss, busy, total);
+  if (ss->num_cpus == 0)
+    die("no per-CPU lines in /proc/stat");
+
+  // Decide once which diskstats lines describe whole disks
+  size_t len = sys_read(ss, ss->fd_disk);
+  const char *p = ss->buf, *end = ss->buf + len;
+  for (int line = 0; p < end && line < SYS_MAX_DISK_LINES;
+       p = next_line(p, end), line++) {
+    const char *q = p;
+    (void)scan_u64(&q, end);
+    (void)scan_u64(&q, end);
+    const char *name = skip_blanks(q, end);
+    q = name;
+    while (q < end && *q != ' ' && *q != '\n')
+      q++;
+    ss->disk_line[line] = sys_is_disk(name, (size_t)(q - name));
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  sys_sample(ss, &now);
+  return ss->num_cpus + SYS_IO_METRICS;
+}
+
+/// Sample when due, then ease every wave toward its metric's level.
+static void sys_update(SysState *ss, Wave *waves, int n) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (elapsed_sec(&ss->last, &now) * 1000.0 >= ss->interval_ms)
+    sys_sample(ss, &now);
+  for (int w = 0; w < n; w++) {
+    ss->level[w] += (ss->target[w] - ss->level[w]) * SYS_EASE;
+    waves[w].amp = SYS_MIN_AMP + (0.9 - SYS_MIN_AMP) * ss->level[w];
+  }
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Pipe throughput visualizer (--pv)
+// ════════════════════════════════════════════════════════════════════
+//
+// A pump thread moves stdin to stdout with splice(): directly when one
+// side already is a pipe, otherwise through a private kernel pipe. Data
+// never enters userspace; the thread only adds byte counts to an atomic
+// the render loop samples once per frame. Frames go to /dev/tty.
+
+/// splice() everything from `in` to `out` via `via` (or directly when
+/// via is NULL). Returns 0 at EOF, -1 with errno set on failure.
+static int pv_splice_loop(PvState *pv, int in, int out, const int *via) {
+  for (;;) {
+    ssize_t n;
+    if (!via) {
+      n = splice(in, NULL, out, NULL, PV_SPLICE_CHUNK, SPLICE_F_MORE);
+      if (n > 0)
+        atomic_fetch_add_explicit(&pv->bytes, (uint64_t)n,
+                                  memory_order_relaxed);
+    } else {
+      n = splice(in, NULL, via[1], NULL, PV_SPLICE_CHUNK,
+                 SPLICE_F_MOVE | SPLICE_F_MORE);
+      for (ssize_t left = n; left > 0;) {
+        ssize_t m = splice(via[0], NULL, out, NULL, (size_t)left,
+                           SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (m < 0 && errno == EINTR)
+          continue;
+        if (m <= 0)
+          return -1;
+        left -= m;
+        atomic_fetch_add_explicit(&pv->bytes, (uint64_t)m,
+                                  memory_order_relaxed);
+      }
+    }
+    if (n == 0)
+      return 0;
+    if (n < 0 && errno != EINTR)
+      return -1;
+  }
+}
+
+/// Plain read()/write() fallback for descriptors splice() rejects.
+static int pv_copy_loop(PvState *pv, int in, int out) {
+  char *buf = xmalloc(PV_SPLICE_CHUNK);
+  int rc = 0;
+  for (;;) {
+    ssize_t n = read(in, buf, PV_SPLICE_CHUNK);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      rc = n < 0 ? -1 : 0;
+      break;
+    }
+    for (ssize_t off = 0; off < n;) {
+      ssize_t m = write(out, buf + off, (size_t)(n - off));
+      if (m < 0 && errno == EINTR)
+        continue;
+      if (m <= 0) {
+        rc = -1;
+        goto out;
+      }
+      off += m;
+      atomic_fetch_add_explicit(&pv->bytes, (uint64_t)m,
+                                memory_order_relaxed);
+    }
+  }
+out:
+  free(buf);
+  return rc;
+}
+
+static void *pv_pump(void *arg) {
+  PvState *pv = arg;
+  int rc = pv_splice_loop(pv, STDIN_FILENO, STDOUT_FILENO, NULL);
+  if (rc < 0 && errno == EINVAL) {
+    // Neither side is a pipe: bounce through one of our own
+    int via[2];
+    if (pipe(via) == 0) {
+      (void)fcntl(via[1], F_SETPIPE_SZ, PV_PIPE_SIZE);
+      rc = pv_splice_loop(pv, STDIN_FILENO, STDOUT_FILENO, via);
+      close(via[0]);
+      close(via[1]);
+    }
+  }
+  if (rc < 0 && errno == EINVAL)
+    rc = pv_copy_loop(pv, STDIN_FILENO, STDOUT_FILENO);
+  pv->failed = rc < 0 && errno != EPIPE;
+  atomic_store_explicit(&pv->done, true, memory_order_release);
+  return NULL;
+}
+
+/// Open the controlling terminal for frames and start the pump.
+static int pv_start(PvState *pv) {
+  int tty = open("/dev/tty", O_RDWR | O_CLOEXEC);
+  if (tty < 0)
+    die("--pv needs a controlling terminal: %s", strerror(errno));
+  // A consumer that quits early must not kill us with the terminal raw
+  signal(SIGPIPE, SIG_IGN);
+  atomic_init(&pv->bytes, 0);
+  atomic_init(&pv->done, false);
+  clock_gettime(CLOCK_MONOTONIC, &pv->start);
+  pv->last = pv->start;
+
+  pthread_t tid;
+  if (pthread_create(&tid, NULL, pv_pump, pv) != 0)
+    die("cannot start pipe pump thread");
+  pthread_detach(tid);
+  return tty;
+}
+
+/// Sample the byte counter. Wave w shows the rate averaged over a window
+/// that grows with w, from instantaneous to several seconds.
+/// Returns false once the pump has finished.
+static bool pv_update(PvState *pv, Wave *waves, int n) {
+  bool done = atomic_load_explicit(&pv->done, memory_order_acquire);
+  uint64_t bytes = atomic_load_explicit(&pv->bytes, memory_order_relaxed);
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double dt = elapsed_sec(&pv->last, &now);
+  if (dt <= 0.0)
+    return !done;
+  double rate = (double)(bytes - pv->last_bytes) / dt;
+  pv->last = now;
+  pv->last_bytes = bytes;
+
+  pv->peak *= PV_PEAK_DECAY;
+  if (pv->peak < rate)
+    pv->peak = rate;
+  if (pv->peak < PV_RATE_FLOOR)
+    pv->peak = PV_RATE_FLOOR;
+
+  for (int w = 0; w < n; w++) {
+    double tau = PV_MIN_TAU * pow(PV_MAX_TAU / PV_MIN_TAU,
+                                  n > 1 ? (double)w / (n - 1) : 0.0);
+    double k = 1.0 - exp(-dt / tau);
+    pv->avg[w] += (rate - pv->avg[w]) * k;
+    waves[w].amp = 0.05 + 0.85 * pv->avg[w] / pv->peak;
+  }
+  return !done;
+}
+
+/// Format a byte count with a binary unit suffix.
+static void format_bytes(char *out, size_t cap, double v) {
+  static const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB", "PiB"};
+  int u = 0;
+  while (v >= 1024.0 && u < 5) {
+    v /= 1024.0;
+    u++;
+  }
+  snprintf(out, cap, u ? "%.2f %s" : "%.0f %s", v, units[u]);
+}
+
+/// Status line (rate, total, elapsed) for the bottom row of the region.
+static size_t pv_status(const PvState *pv, int n, char *buf, size_t cap) {
+  char rate[32], total[32];
+  format_bytes(rate, sizeof(rate), pv->avg[n > 1 ? 1 : 0]);
+  format_bytes(total, sizeof(total), (double)pv->last_bytes);
+  int len = snprintf(buf, cap,
+                     "\033[1;38;5;255m %s/s \033[0;38;5;248m"
+                     "%s in %.1fs \033[0m",
+                     rate, total, elapsed_sec(&pv->start, &pv->last));
+  return len > 0 && (size_t)len < cap ? (size_t)len : 0;
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Command wrapper (wave -- cmd ...)
+// ════════════════════════════════════════════════════════════════════
+//
+// The child runs on a pseudo-terminal sized to the rows above the wave
+// strip, and a DECSTBM scroll region keeps its output there. Between
+// frames the loop blocks in poll() forwarding child output in large
+// chunks; the strip is drawn inside DECSC/DECRC so the child's cursor
+// and attributes are untouched. Frames are held back while the child's
+// output stream is in the middle of an escape or UTF-8 sequence.
+
+/// Advance the escape/UTF-8 tracker over forwarded child output.
+static void wrap_track(WrapState *ws, const unsigned char *p, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    unsigned char c = p[i];
+    switch (ws->esc) {
+    case WRAP_GROUND:
+      if (ws->utf8_left) {
+        ws->utf8_left--;
+      } else if (c == 0x1b) {
+        ws->esc = WRAP_ESC;
+      } else if (c >= 0xC0) {
+        ws->utf8_left = c >= 0xF0 ? 3 : (c >= 0xE0 ? 2 : 1);
+      }
+      break;
+    case WRAP_ESC:
+      // Intermediate bytes (ESC ( B) and a repeated ESC keep it open
+      if (c == '[')
+        ws->esc = WRAP_CSI;
+      else if (c == ']' || c == 'P' || c == 'X' || c == '^' || c == '_')
+        ws->esc = WRAP_STR; // OSC, DCS, SOS, PM, APC
+      else if (c != 0x1b && (c < 0x20 || c > 0x2F))
+        ws->esc = WRAP_GROUND;
+      break;
+    case WRAP_CSI:
+      if (c >= 0x40 && c <= 0x7E)
+        ws->esc = WRAP_GROUND;
+      break;
+    case WRAP_STR:
+      // Strings end only on BEL or ST (ESC \); their payload may hold
+      // anything else, backslashes included
+      if (c == 0x07)
+        ws->esc = WRAP_GROUND;
+      else if (c == 0x1b)
+        ws->esc = WRAP_STR_ESC;
+      break;
+    case WRAP_STR_ESC:
+      // Anything but ST leaves the string open (tmux doubles its ESCs)
+      ws->esc = c == '\\' ? WRAP_GROUND : WRAP_STR;
+      break;
+    }
+  }
+}
+
+static void write_all(int fd, const void *buf, size_t n) {
+  const char *p = buf;
+  while (n > 0) {
+    ssize_t m = write(fd, p, n);
+    if (m < 0 && errno == EINTR)
+      continue;
+    if (m <= 0)
+      return;
+    p += m;
+    n -= (size_t)m;
+  }
+}
+
+/// Confine scrolling to the child's rows and tell the child its size.
+static void wrap_resize(WrapState *ws, int child_rows, int cols) {
+  struct winsize wsz = {.ws_row = (unsigned short)child_rows,
+                        .ws_col = (unsigned short)cols};
+  ioctl(ws->master, TIOCSWINSZ, &wsz);
+  char seq[32];
+  int n = snprintf(seq, sizeof(seq), "\0337\033[1;%dr\0338", child_rows);
+  write_all(STDOUT_FILENO, seq, (size_t)n);
+}
+
+/// Start argv[0] on a new pty. The terminal is cleared and stdin is put
+/// in raw mode so every key press reaches the child unchanged.
+static void wrap_start(WrapState *ws, char **argv, int child_rows,
+                       int cols) {
+  ws->master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (ws->master < 0 || grantpt(ws->master) != 0 ||
+      unlockpt(ws->master) != 0)
+    die("cannot allocate a pseudo-terminal: %s", strerror(errno));
+  const char *slave = ptsname(ws->master);
+  if (!slave)
+    die("cannot name the pseudo-terminal: %s", strerror(errno));
+
+  struct winsize wsz = {.ws_row = (unsigned short)child_rows,
+                        .ws_col = (unsigned short)cols};
+  ws->pid = fork();
+  if (ws->pid < 0)
+    die("cannot fork: %s", strerror(errno));
+  if (ws->pid == 0) {
+    setsid();
+    int fd = open(slave, O_RDWR);
+    if (fd < 0)
+      _exit(127);
+    ioctl(fd, TIOCSCTTY, 0);
+    ioctl(fd, TIOCSWINSZ, &wsz);
+    dup2(fd, STDIN_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    if (fd > STDERR_FILENO)
+      close(fd);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGWINCH, SIG_DFL);
+    execvp(argv[0], argv);
+    fprintf(stderr, "wave: cannot run '%s': %s\n", argv[0], strerror(errno));
+    _exit(127);
+  }
+
+  ws->stdin_open = true;
+  if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &g_saved_tio) == 0) {
+    struct termios raw = g_saved_tio;
+    cfmakeraw(&raw);
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0)
+      g_tio_saved = true;
+  }
+  const char init[] = "\033[2J\033[H";
+  write_all(STDOUT_FILENO, init, sizeof(init) - 1);
+  wrap_resize(ws, child_rows, cols);
+}
+
+/// Forward child output and user input until `budget_us` has passed.
+/// Returns false once the child has closed its terminal.
+static bool wrap_pump(WrapState *ws, long budget_us) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_nsec += budget_us * 1000;
+  deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+  deadline.tv_nsec %= 1000000000L;
+
+  for (;;) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double left = elapsed_sec(&now, &deadline);
+    if (left <= 0.0)
+      return true;
+
+    struct pollfd pfd[2] = {
+        {.fd = ws->master, .events = POLLIN},
+        {.fd = STDIN_FILENO, .events = POLLIN},
+    };
+    int r = poll(pfd, ws->stdin_open ? 2 : 1, (int)ceil(left * 1000.0));
+    if (r < 0 && errno == EINTR) {
+      if (g_resized || g_quit)
+        return true;
+      continue;
+    }
+    if (r <= 0)
+      return true;
+
+    if (pfd[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      ssize_t n = read(ws->master, ws->buf, sizeof(ws->buf));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false; // EIO: every slave descriptor is closed
+      write_all(STDOUT_FILENO, ws->buf, (size_t)n);
+      wrap_track(ws, (const unsigned char *)ws->buf, (size_t)n);
+    }
+    if (ws->stdin_open && (pfd[1].revents & (POLLIN | POLLHUP))) {
+      char in[4096];
+      ssize_t n = read(STDIN_FILENO, in, sizeof(in));
+      if (n <= 0)
+        ws->stdin_open = false;
+      else
+        write_all(ws->master, in, (size_t)n);
+    }
+  }
+}
+
+/// True when a frame can be spliced into the output stream safely.
+static bool wrap_can_draw(const WrapState *ws) {
+  return ws->esc == WRAP_GROUND && ws->utf8_left == 0;
+}
+
+/// Reap the child, restore full-screen scrolling and erase the strip.
+/// Returns the exit code `wave` should use: the child's, or 128+signal.
+static int wrap_finish(WrapState *ws, int strip_row) {
+  char seq[48];
+  int n = snprintf(seq, sizeof(seq), "\033[r\033[%d;1H\033[J", strip_row);
+  write_all(STDOUT_FILENO, seq, (size_t)n);
+  close(ws->master);
+  int status = 0;
+  while (waitpid(ws->pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  if (WIFEXITED(status))
+    return WEXITSTATUS(status);
+  if (WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+  return EXIT_ERR;
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Progress indicator (--progress)
+// ════════════════════════════════════════════════════════════════════
+//
+// Lines like "42", "42%", "Step 3/10" set a fraction in [0, 1] that
+// becomes the water level. Between frames the loop sleeps in poll() on
+// the input, so a new value is drawn at once and otherwise nothing runs
+// until the next animation tick.
+
+/// Extract a fraction from one line: "done/total" if a slash is
+/// present, else the last number on the line read as a percentage.
+static bool progress_parse(const char *p, const char *end, double *out) {
+  const char *slash = memchr(p, '/', (size_t)(end - p));
+  if (slash) {
+    const char *a = slash, *b = slash + 1;
+    while (a > p && a[-1] != ' ' && a[-1] != '\t' && a[-1] != '(' &&
+           a[-1] != '[')
+      a--;
+    const char *e = b;
+    while (e < end && ((*e >= '0' && *e <= '9') || *e == '.'))
+      e++;
+    double done, total;
+    if (scan_number(a, slash, &done) && scan_number(b, e, &total) &&
+        total > 0.0) {
+      *out = done / total;
+      return true;
+    }
+  }
+  const char *q = end;
+  while (q > p && (q[-1] == '%' || q[-1] == ' ' || q[-1] == '\r'))
+    q--;
+  const char *tok = q;
+  while (tok > p && tok[-1] != ' ' && tok[-1] != '\t' && tok[-1] != ':')
+    tok--;
+  if (q > tok && scan_number(tok, q, out)) {
+    *out /= 100.0;
+    return true;
+  }
+  return false;
+}
+
+/// Wait until the next tick is due or the input changes the value.
+/// Returns false once the input has ended and its last value is shown.
+static bool progress_wait(ProgressState *ps, long budget_us) {
+  if (ps->eof)
+    return false;
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_nsec += budget_us * 1000;
+  deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+  deadline.tv_nsec %= 1000000000L;
+
+  for (;;) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double left = elapsed_sec(&now, &deadline);
+    if (left <= 0.0)
+      return true;
+    struct pollfd pfd = {.fd = ps->fd, .events = POLLIN};
+    int r = poll(&pfd, 1, (int)ceil(left * 1000.0));
+    if (r < 0 && errno == EINTR) {
+      if (g_resized || g_quit)
+        return true;
+      continue;
+    }
+    if (r <= 0)
+      return true;
+
+    ssize_t n = read(ps->fd, ps->buf + ps->len, sizeof(ps->buf) - ps->len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    double before = ps->value;
+    const char *p = ps->buf;
+    const char *end = ps->buf + ps->len + (n > 0 ? (size_t)n : 0);
+    for (;;) {
+      const char *nl = memchr(p, '\n', (size_t)(end - p));
+      if (!nl && n > 0)
+        break;
+      const char *eol = nl ? nl : end;
+      double v;
+      if (progress_parse(p, eol, &v))
+        ps->value = v < 0.0 ? 0.0 : (v > 1.0 ? 1.0 : v);
+      if (!nl)
+        break;
+      p = nl + 1;
+    }
+    if (n <= 0) {
+      ps->eof = true;
+      ps->len = 0;
+      return true;
+    }
+    ps->len = (size_t)(end - p);
+    if (ps->len == sizeof(ps->buf))
+      ps->len = 0;
+    else if (ps->len)
+      memmove(ps->buf, p, ps->len);
+    if (ps->value != before)
+      return true;
+  }
+}
+
+/// Ease the drawn level toward the latest value; returns the level row.
+static int progress_level(ProgressState *ps, int rows) {
+  ps->shown += (ps->value - ps->shown) * PROGRESS_EASE;
+  if (fabs(ps->value - ps->shown) < 1e-3)
+    ps->shown = ps->value;
+  return (int)lround((1.0 - ps->shown) * (rows - 1));
+}
+
+/// Percentage label for the bottom row of the region.
+static size_t progress_status(const ProgressState *ps, char *buf,
+                              size_t cap) {
+  int len = snprintf(buf, cap, "\033[1;38;5;255m %5.1f%% \033[0m",
+                     ps->value * 100.0);
+  return len > 0 && (size_t)len < cap ? (size_t)len : 0;
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Plugins (--plugin)
+// ════════════════════════════════════════════════════════════════════
+//
+// A plugin is a shared object that registers palettes and generators
+// through libwave's registry (see the ABI section of libwave.h). It is
+// loaded while options are parsed, so later --color and --generator
+// options can name what it adds, and stays loaded until exit.
+//
+// `make static` defines WAVE_NO_PLUGINS: dlopen() in a static binary
+// needs the shared glibc it was linked against, which defeats the point.
+
+#ifdef WAVE_NO_PLUGINS
+static void plugin_load(const char *path) {
+  die("cannot load plugin '%s': this build has no plugin support "
+      "(built with make static)",
+      path);
+}
+#else
+static void plugin_load(const char *path) {
+  void *so = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!so)
+    die("cannot load plugin: %s", dlerror());
+  wave_plugin_init_fn init;
+  // dlsym() returns data pointers; POSIX guarantees the conversion
+  *(void **)&init = dlsym(so, WAVE_PLUGIN_ENTRY);
+  if (!init)
+    die("plugin '%s' has no %s()", path, WAVE_PLUGIN_ENTRY);
+  if (init(wave_registry()) != 0)
+    die("plugin '%s' failed to initialize (ABI %d)", path, WAVE_PLUGIN_ABI);
+}
+#endif
+
+/// Report an unknown palette or generator name with the known ones.
+static void die_unknown(const char *what, const char *name,
+                        const char *(*name_at)(int), int count) {
+  fprintf(stderr,
+          "\033[1;31merror:\033[0m unknown %s '%s'\n"
+          "available: ",
+          what, name);
+  for (int i = 0; i < count; i++)
+    fprintf(stderr, "%s%s", name_at(i), i < count - 1 ? ", " : "\n");
+  exit(EXIT_ERR);
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Per-wave shapes (--shape, --wave)
+// ════════════════════════════════════════════════════════════════════
+
+/// Apply --shape and the --wave overrides on top of generated waves.
+static void apply_wave_specs(const WaveConfig *cfg, Wave *waves, int n) {
+  for (int w = 0; w < n; w++) {
+    if (cfg->shape >= 0)
+      waves[w].shape = cfg->shape;
+    if (w >= cfg->num_specs)
+      continue;
+    const WaveSpec *sp = &cfg->specs[w];
+    if (sp->set & SPEC_FREQ)
+      waves[w].freq = sp->w.freq;
+    if (sp->set & SPEC_AMP)
+      waves[w].amp = sp->w.amp;
+    if (sp->set & SPEC_SPEED)
+      waves[w].phase_spd = sp->w.phase_spd;
+    if (sp->set & SPEC_SHAPE)
+      waves[w].shape = sp->w.shape;
+    if (sp->set & SPEC_GLYPH)
+      waves[w].glyph = sp->w.glyph;
+    if (sp->set & SPEC_HARM) {
+      waves[w].num_harmonics = sp->w.num_harmonics;
+      memcpy(waves[w].harmonics, sp->w.harmonics,
+             sizeof(waves[w].harmonics));
+    }
+  }
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Physics mode (--physics)
+// ════════════════════════════════════════════════════════════════════
+//
+// libwave simulates the string; the frontend only feeds it impulses
+// from the keyboard on top of the random ones.
+
+/// Apply one key press to the string. Returns false on quit.
+static bool physics_handle_key(int key) {
+  switch (key) {
+  case 'q':
+  case 'Q':
+    return false;
+  case ' ': {
+    // xorshift, like the starfield, for a random spot
+    static unsigned int rng = 0x2545F491u;
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    wave_ctx_impulse(g_ctx, rng / 4294967296.0, PHYSICS_PLUCK);
+    break;
+  }
+  default:
+    // 1..9 pluck at evenly spaced points from left to right
+    if (key >= '1' && key <= '9')
+      wave_ctx_impulse(g_ctx, (key - '1' + 0.5) / 9.0, PHYSICS_PLUCK);
+    break;
+  }
+  return true;
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Ripple mode (--ripple)
+// ════════════════════════════════════════════════════════════════════
+//
+// libwave owns the tank and its worker pool. Clicks drop a stone where
+// they land and drags trail smaller ones behind the pointer.
+
+/// Apply one key press or mouse report to a rows x cols tank. Returns
+/// false on quit.
+static bool ripple_handle_key(int key, int rows, int cols) {
+  switch (key) {
+  case 'q':
+  case 'Q':
+    return false;
+  case ' ': {
+    static unsigned int rng = 0x68E31DA4u;
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    const double x = rng / 4294967296.0;
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    wave_ctx_ripple_impulse(g_ctx, x, rng / 4294967296.0, RIPPLE_CLICK);
+    break;
+  }
+  case KEY_MOUSE: {
+    // Left, middle or right button; wheel and bare motion are ignored
+    const int button = g_mouse.button & ~32;
+    if (g_mouse.release || button > 2)
+      break;
+    const double x = (g_mouse.x - 0.5) / cols;
+    const double y = (g_mouse.y - 0.5) / rows;
+    wave_ctx_ripple_impulse(g_ctx, x, y,
+                            g_mouse.button & 32 ? RIPPLE_DRAG : RIPPLE_CLICK);
+    break;
+  }
+  default:
+    break;
+  }
+  return true;
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Hardware counters (--perf-counters)
+// ════════════════════════════════════════════════════════════════════
+//
+// One perf_event group (cycles, instructions, cache misses, branch
+// misses) on the render thread, read with a single read() at every
+// stage boundary so each stage is charged what it executed. Worker
+// threads of --ripple and --3d are not counted. Without a PMU or the
+// privilege to use it, counters that cannot be opened are left out and
+// the frame loop runs as before.
+
+static const uint64_t hw_config[HW_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+static int hw_open(uint64_t config, int group, bool user_only) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.exclude_kernel = user_only;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group,
+                      PERF_FLAG_FD_CLOEXEC);
+}
+
+/// Open as many of the counters as the host allows. Kernel time (the
+/// write stage is mostly that) is only excluded when it must be.
+static void perf_start(PerfState *ps) {
+  ps->leader = -1;
+  for (int e = 0; e < HW_COUNT; e++) {
+    int fd = hw_open(hw_config[e], ps->leader, ps->user_only);
+    if (fd < 0 && ps->leader < 0 && !ps->user_only &&
+        (errno == EACCES || errno == EPERM)) {
+      ps->user_only = true;
+      fd = hw_open(hw_config[e], ps->leader, true);
+    }
+    ps->fd[e] = fd;
+    ps->slot[e] = -1;
+    if (fd < 0) {
+      if (ps->leader < 0)
+        ps->err = errno;
+      continue;
+    }
+    if (ps->leader < 0)
+      ps->leader = fd;
+    ps->slot[e] = ps->num_open++;
+  }
+  if (!ps->num_open)
+    snprintf(ps->hud, sizeof(ps->hud), " perf counters unavailable: %s ",
+             strerror(ps->err));
+}
+
+static bool perf_read(PerfState *ps, uint64_t *v) {
+  uint64_t buf[1 + HW_COUNT]; // nr, then one value per open counter
+  ssize_t want = (ssize_t)sizeof(uint64_t) * (1 + ps->num_open);
+  if (read(ps->leader, buf, sizeof(buf)) < want)
+    return false;
+  for (int e = 0; e < HW_COUNT; e++)
+    v[e] = ps->slot[e] >= 0 ? buf[1 + ps->slot[e]] : 0;
+  return true;
+}
+
+/// Start charging a frame's first stage.
+static void perf_mark(PerfState *ps) {
+  if (ps->num_open)
+    perf_read(ps, ps->last);
+}
+
+/// Charge everything since the last boundary to `stage`.
+static void perf_stage(PerfState *ps, int stage) {
+  uint64_t now[HW_COUNT];
+  if (!ps->num_open || !perf_read(ps, now))
+    return;
+  for (int e = 0; e < HW_COUNT; e++) {
+    uint64_t d = now[e] - ps->last[e];
+    ps->total[stage][e] += d;
+    ps->window[stage][e] += d;
+    ps->last[e] = now[e];
+  }
+}
+
+/// Ratio for a report, negative if either counter is missing.
+static double perf_ratio(const PerfState *ps, const uint64_t *c, int num,
+                         int den, uint64_t cells) {
+  if (ps->slot[num] < 0 || (den >= 0 && ps->slot[den] < 0))
+    return -1;
+  double d = den >= 0 ? (double)c[den] : (double)cells;
+  return d > 0 ? (double)c[num] / d : 0;
+}
+
+/// Rebuild the HUD line from the counts since the last refresh.
+static void perf_hud(PerfState *ps) {
+  size_t len = 0;
+  uint64_t miss[HW_COUNT] = {0};
+  int n = snprintf(ps->hud, sizeof(ps->hud), " ipc");
+  len += n > 0 ? (size_t)n : 0;
+  for (int s = 0; s < STAGE_COUNT && len < sizeof(ps->hud); s++) {
+    const uint64_t *c = ps->window[s];
+    n = snprintf(ps->hud + len, sizeof(ps->hud) - len, " %s %.2f",
+                 stage_names[s],
+                 perf_ratio(ps, c, HW_INSTRUCTIONS, HW_CYCLES, 0));
+    len += n > 0 ? (size_t)n : 0;
+    miss[HW_CACHE_MISSES] += c[HW_CACHE_MISSES];
+    miss[HW_BRANCH_MISSES] += c[HW_BRANCH_MISSES];
+  }
+  if (len < sizeof(ps->hud))
+    snprintf(ps->hud + len, sizeof(ps->hud) - len,
+             " | per cell %.4f cache %.4f branch misses ",
+             perf_ratio(ps, miss, HW_CACHE_MISSES, -1, ps->window_cells),
+             perf_ratio(ps, miss, HW_BRANCH_MISSES, -1, ps->window_cells));
+  memset(ps->window, 0, sizeof(ps->window));
+  ps->window_cells = 0;
+}
+
+/// Count a finished frame of `cells` cells; refresh the HUD once per
+/// PERF_HUD_PERIOD.
+static void perf_frame(PerfState *ps, uint64_t cells, uint64_t now_us) {
+  if (!ps->num_open)
+    return;
+  ps->frames++;
+  ps->cells += cells;
+  ps->window_cells += cells;
+  if (now_us - ps->window_start_us >= PERF_HUD_PERIOD) {
+    perf_hud(ps);
+    ps->window_start_us = now_us;
+  }
+}
+
+/// Draw the HUD over the top row of the region, cut to its width.
+static size_t perf_status(const PerfState *ps, int cols, char *buf,
+                          size_t cap) {
+  size_t len = strlen(ps->hud);
+  if (len > (size_t)cols)
+    len = (size_t)cols;
+  int n = snprintf(buf, cap, "\033[0;38;5;248m%.*s\033[0m", (int)len,
+                   ps->hud);
+  return n > 0 && (size_t)n < cap ? (size_t)n : 0;
+}
+
+static void perf_print_row(const PerfState *ps, const char *name,
+                           const uint64_t *c) {
+  const double v[3] = {
+      perf_ratio(ps, c, HW_INSTRUCTIONS, HW_CYCLES, 0),
+      perf_ratio(ps, c, HW_CACHE_MISSES, -1, ps->cells),
+      perf_ratio(ps, c, HW_BRANCH_MISSES, -1, ps->cells)};
+  fprintf(stderr, "  %-8s", name);
+  for (int i = 0; i < 3; i++)
+    if (v[i] < 0)
+      fprintf(stderr, " %16s", "-");
+    else
+      fprintf(stderr, " %16.4f", v[i]);
+  fputc('\n', stderr);
+}
+
+/// Print the per-stage summary and close the counters.
+static void perf_stop(PerfState *ps) {
+  if (!ps->num_open) {
+    fprintf(stderr, "wave: hardware counters unavailable: %s\n",
+            strerror(ps->err));
+    return;
+  }
+  fprintf(stderr,
+          "wave: hardware counters over %" PRIu64 " frames, %" PRIu64
+          " cells%s\n",
+          ps->frames, ps->cells, ps->user_only ? " (user space only)" : "");
+  fprintf(stderr, "  %-8s %16s %16s %16s\n", "stage", "ipc",
+          "cache miss/cell", "branch miss/cell");
+  uint64_t all[HW_COUNT] = {0};
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    perf_print_row(ps, stage_names[s], ps->total[s]);
+    for (int e = 0; e < HW_COUNT; e++)
+      all[e] += ps->total[s][e];
+  }
+  perf_print_row(ps, "frame", all);
+  for (int e = 0; e < HW_COUNT; e++)
+    if (ps->fd[e] >= 0)
+      close(ps->fd[e]);
+  ps->num_open = 0;
+}
+
+// ════════════════════════════════════════════════════════════════════
+//  Frame pipeline trace (--trace)
 // ════════════════════════════════════════════════════════════════════
+//
+// Begin/end events for every frame and each of its stages, resizes and
+// the signals behind them go into a buffer allocated up front; each
+// event is a 16-byte store. Only at exit is the buffer written out in
+// the Chrome trace-event format for chrome://tracing or Perfetto. Once
+// the buffer is full, later frames are counted but not recorded.
 
-typedef struct {
-  double freq;
-  double amp;
-  double phase_spd;
-  const char *glyph;
-} Wave;
+static const char *const trace_names[TRACE_NAMES] = {
+    "clear", "simulate", "plot", "encode", "write", "frame",
+    "resize", "SIGWINCH", "SIGINT", "SIGTERM"};
 
-typedef struct {
-  double speed_mult;
-  int fps;
-  int num_waves;
-  const char *color_name;
-  const char *glyph; // NULL = use per-wave defaults
-} WaveConfig;
+/// Open the output now, so a bad path fails before the screen is taken.
+static void trace_start(TraceState *ts, const char *path, uint64_t epoch) {
+  ts->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (ts->fd < 0)
+    die("cannot open trace output '%s': %s", path, strerror(errno));
+  ts->events = xmalloc(TRACE_MAX_EVENTS * sizeof(*ts->events));
+  ts->epoch_us = epoch;
+}
 
-// ── Palette entry ──────────────────────────────────────────────────
-typedef int (*palette_fn)(double t);
+static void trace_event(TraceState *ts, int name, char phase, uint64_t at) {
+  if (ts->fd < 0 || ts->full || ts->len == TRACE_MAX_EVENTS)
+    return;
+  ts->events[ts->len++] = (TraceEvent){
+      .ts_us = at > ts->epoch_us ? at - ts->epoch_us : 0,
+      .frame = ts->frame,
+      .name = (uint8_t)name,
+      .phase = phase,
+  };
+}
 
-typedef struct {
-  const char *name;
-  palette_fn fn;
-} Palette;
+/// Open a frame and its first stage, if a whole frame still fits.
+static void trace_frame(TraceState *ts, uint64_t frame, uint64_t at) {
+  if (ts->fd < 0)
+    return;
+  ts->frame = (uint32_t)frame;
+  if (ts->len > TRACE_MAX_EVENTS - TRACE_FRAME_EVENTS) {
+    ts->full = true; // stop here rather than mid-frame
+    ts->frames_dropped++;
+    return;
+  }
+  trace_event(ts, TRACE_FRAME, 'B', at);
+  trace_event(ts, STAGE_CLEAR, 'B', at);
+  ts->open_stage = STAGE_CLEAR;
+}
 
-// ════════════════════════════════════════════════════════════════════
-//  Globals for signal handlers (minimal — async-signal-safe only)
-// ════════════════════════════════════════════════════════════════════
+/// Close a stage and open the next, or close the frame after the last.
+static void trace_stage(TraceState *ts, int stage, uint64_t at) {
+  if (ts->open_stage != stage)
+    return; // the frame was not recorded
+  trace_event(ts, stage, 'E', at);
+  trace_event(ts, stage + 1 < STAGE_COUNT ? stage + 1 : TRACE_FRAME,
+              stage + 1 < STAGE_COUNT ? 'B' : 'E', at);
+  ts->open_stage = stage + 1 < STAGE_COUNT ? stage + 1 : -1;
+}
 
-static volatile sig_atomic_t g_resized = 1; // force initial read
-static volatile sig_atomic_t g_quit = 0;
+/// Record a signal at the time its handler ran, if it ran at all.
+static void trace_signal(TraceState *ts, int name,
+                         _Atomic uint64_t *when) {
+  uint64_t at = atomic_exchange_explicit(when, 0, memory_order_relaxed);
+  if (at)
+    trace_event(ts, name, 'i', at);
+}
 
-// Resources tracked globally so cleanup is centralized
-static char *g_frame_buf = NULL;
-static int *g_fb = NULL;
-static double *g_fbval = NULL;
-static Wave *g_waves = NULL;
-static double *g_phase = NULL;
+static void trace_flush(TraceState *ts, char *out, size_t *len) {
+  write_all(ts->fd, out, *len);
+  *len = 0;
+}
+
+/// Write the buffer as a JSON object and release it.
+static void trace_stop(TraceState *ts) {
+  if (ts->fd < 0)
+    return;
+  // A loop that left mid-frame (input ended) leaves a stage open
+  if (ts->open_stage >= 0) {
+    const uint64_t now = mono_us();
+    trace_event(ts, ts->open_stage, 'E', now);
+    trace_event(ts, TRACE_FRAME, 'E', now);
+    ts->open_stage = -1;
+  }
+  char *out = xmalloc(TRACE_OUT_SIZE);
+  size_t len = 0;
+  const int pid = (int)getpid();
+  int n = snprintf(out, TRACE_OUT_SIZE,
+                   "{\"displayTimeUnit\":\"ms\",\"otherData\":{"
+                   "\"version\":\"wave %s\",\"frames_dropped\":%" PRIu64
+                   "},\"traceEvents\":[\n"
+                   "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                   "\"tid\":1,\"args\":{\"name\":\"wave\"}},\n"
+                   "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                   "\"tid\":1,\"args\":{\"name\":\"render\"}}",
+                   WAVE_VERSION, ts->frames_dropped, pid, pid);
+  len = n > 0 ? (size_t)n : 0;
+  for (size_t i = 0; i < ts->len; i++) {
+    const TraceEvent *e = &ts->events[i];
+    if (TRACE_OUT_SIZE - len < 256)
+      trace_flush(ts, out, &len);
+    n = snprintf(out + len, TRACE_OUT_SIZE - len,
+                 ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRIu64
+                 ",\"pid\":%d,\"tid\":1",
+                 trace_names[e->name], e->phase, e->ts_us, pid);
+    len += n > 0 ? (size_t)n : 0;
+    if (e->phase == 'i')
+      n = snprintf(out + len, TRACE_OUT_SIZE - len, ",\"s\":\"p\"}");
+    else if (e->name == TRACE_FRAME && e->phase == 'B')
+      n = snprintf(out + len, TRACE_OUT_SIZE - len,
+                   ",\"args\":{\"frame\":%" PRIu32 "}}", e->frame);
+    else
+      n = snprintf(out + len, TRACE_OUT_SIZE - len, "}");
+    len += n > 0 ? (size_t)n : 0;
+  }
+  n = snprintf(out + len, TRACE_OUT_SIZE - len, "\n]}\n");
+  len += n > 0 ? (size_t)n : 0;
+  trace_flush(ts, out, &len);
+  free(out);
+  close(ts->fd);
+  ts->fd = -1;
+  free(ts->events);
+  ts->events = NULL;
+}
 
 // ════════════════════════════════════════════════════════════════════
-//  Error handling helpers
+//  Frame metrics (--metrics-out)
 // ════════════════════════════════════════════════════════════════════
+//
+// The render loop only timestamps its stages and copies a fixed-size
+// record into a single-producer / single-consumer ring; when the ring is
+// full the record is dropped and counted, never waited for. A writer
+// thread at SCHED_IDLE priority wakes every METRICS_DRAIN_MS, formats
+// what has accumulated as JSON lines and appends it with one write() per
+// batch, so neither formatting nor file I/O ever lands on a frame.
 
-__attribute__((format(printf, 1, 2))) static void die(const char *fmt, ...) {
+/// Start timing a frame's first stage.
+static uint64_t stage_begin(uint64_t frame) {
+  perf_mark(&g_perf);
+  uint64_t now = mono_us();
+  trace_frame(&g_trace, frame, now);
+  return now;
+}
+
+/// Close the current stage: store its duration and start the next.
+static void stage_end(FrameRecord *rec, int stage, uint64_t *mark) {
+  uint64_t now = mono_us();
+  perf_stage(&g_perf, stage);
+  trace_stage(&g_trace, stage, now);
+  rec->stage_us[stage] = (uint32_t)(now - *mark);
+  *mark = now;
+}
+
+/// Hand a finished frame to the writer. Never blocks.
+static void metrics_push(MetricsState *ms, const FrameRecord *rec) {
+  size_t head = atomic_load_explicit(&ms->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&ms->tail, memory_order_acquire);
+  if (head - tail == METRICS_RING_SIZE) {
+    atomic_fetch_add_explicit(&ms->dropped, 1, memory_order_relaxed);
+    return;
+  }
+  ms->ring[head & (METRICS_RING_SIZE - 1)] = *rec;
+  atomic_store_explicit(&ms->head, head + 1, memory_order_release);
+}
+
+static void metrics_flush(MetricsState *ms) {
+  write_all(ms->fd, ms->out, ms->out_len);
+  ms->out_len = 0;
+}
+
+/// Append one formatted line, flushing first if it might not fit.
+static void metrics_printf(MetricsState *ms, const char *fmt, ...) {
+  if (METRICS_OUT_SIZE - ms->out_len < 1024)
+    metrics_flush(ms);
   va_list ap;
   va_start(ap, fmt);
-  fprintf(stderr, "\033[1;31merror:\033[0m ");
-  vfprintf(stderr, fmt, ap);
-  fputc('\n', stderr);
+  int n = vsnprintf(ms->out + ms->out_len, METRICS_OUT_SIZE - ms->out_len,
+                    fmt, ap);
   va_end(ap);
-  exit(EXIT_ERR);
+  if (n > 0 && (size_t)n < METRICS_OUT_SIZE - ms->out_len)
+    ms->out_len += (size_t)n;
 }
 
-static void die_oom(const char *context) {
-  fprintf(stderr, "\033[1;31mfatal:\033[0m out of memory (%s)\n", context);
-  exit(EXIT_OOM);
+static void metrics_emit_frame(MetricsState *ms, const FrameRecord *r,
+                               uint64_t dropped) {
+  metrics_printf(ms, "{\"frame\":%" PRIu64 ",\"t\":%.6f", r->frame,
+                 r->start_us / 1e6);
+  for (int s = 0; s < STAGE_COUNT; s++)
+    metrics_printf(ms, ",\"%s_us\":%" PRIu32, stage_names[s],
+                   r->stage_us[s]);
+  metrics_printf(ms,
+                 ",\"bytes\":%" PRIu32 ",\"missed\":%s,\"resized\":%s,"
+                 "\"fps\":%d,\"waves\":%d,\"rows\":%d,\"cols\":%d,"
+                 "\"dropped\":%" PRIu64 "}\n",
+                 r->bytes, r->missed ? "true" : "false",
+                 r->resized ? "true" : "false", r->fps, r->waves, r->rows,
+                 r->cols, dropped);
 }
 
-/// Safe malloc wrapper — aborts on allocation failure.
-static void *xmalloc(size_t size) {
-  void *p = malloc(size);
-  if (!p && size > 0)
-    die_oom("malloc");
-  return p;
+static void metrics_emit_window(MetricsState *ms, uint64_t dropped) {
+  if (!ms->window_frames)
+    return;
+  const FrameRecord *r = &ms->window;
+  metrics_printf(ms, "{\"t\":%.6f,\"frames\":%" PRIu64,
+                 ms->window_start_us / 1e6, ms->window_frames);
+  for (int s = 0; s < STAGE_COUNT; s++)
+    metrics_printf(ms, ",\"%s_us_avg\":%.1f,\"%s_us_max\":%" PRIu32,
+                   stage_names[s],
+                   (double)ms->window_sum[s] / ms->window_frames,
+                   stage_names[s], ms->window_max[s]);
+  metrics_printf(ms,
+                 ",\"bytes\":%" PRIu64 ",\"missed\":%" PRIu64
+                 ",\"resizes\":%" PRIu64 ",\"fps\":%d,\"waves\":%d,"
+                 "\"rows\":%d,\"cols\":%d,\"dropped\":%" PRIu64 "}\n",
+                 ms->window_bytes, ms->window_missed, ms->window_resizes,
+                 r->fps, r->waves, r->rows, r->cols, dropped);
+  ms->window_frames = ms->window_bytes = 0;
+  ms->window_missed = ms->window_resizes = 0;
+  memset(ms->window_sum, 0, sizeof(ms->window_sum));
+  memset(ms->window_max, 0, sizeof(ms->window_max));
 }
 
-/// Safe calloc wrapper — aborts on allocation failure.
-static void *xcalloc(size_t count, size_t size) {
-  void *p = calloc(count, size);
-  if (!p && count > 0 && size > 0)
-    die_oom("calloc");
-  return p;
+/// Fold a record into the current one-second window, emitting the
+/// window first if the record starts a later second.
+static void metrics_aggregate(MetricsState *ms, const FrameRecord *r,
+                              uint64_t dropped) {
+  const uint64_t second = r->start_us / 1000000u * 1000000u;
+  if (ms->window_frames && second != ms->window_start_us)
+    metrics_emit_window(ms, dropped);
+  if (!ms->window_frames)
+    ms->window_start_us = second;
+  ms->window = *r;
+  ms->window_frames++;
+  ms->window_bytes += r->bytes;
+  ms->window_missed += r->missed;
+  ms->window_resizes += r->resized;
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    ms->window_sum[s] += r->stage_us[s];
+    if (ms->window_max[s] < r->stage_us[s])
+      ms->window_max[s] = r->stage_us[s];
+  }
 }
 
-/// Safe realloc wrapper — preserves original pointer on failure.
-static void *xrealloc(void *ptr, size_t size) {
-  void *p = realloc(ptr, size);
-  if (!p && size > 0)
-    die_oom("realloc");
-  return p;
+/// Format everything the render loop has published so far.
+static void metrics_drain(MetricsState *ms) {
+  size_t tail = atomic_load_explicit(&ms->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&ms->head, memory_order_acquire);
+  uint64_t dropped = atomic_load_explicit(&ms->dropped, memory_order_relaxed);
+  for (; tail != head; tail++) {
+    const FrameRecord *r = &ms->ring[tail & (METRICS_RING_SIZE - 1)];
+    if (ms->aggregate)
+      metrics_aggregate(ms, r, dropped);
+    else
+      metrics_emit_frame(ms, r, dropped);
+    // Free the slot as soon as it has been read
+    atomic_store_explicit(&ms->tail, tail + 1, memory_order_release);
+  }
+  metrics_flush(ms);
 }
 
-// ════════════════════════════════════════════════════════════════════
-//  Signal handlers (async-signal-safe ONLY)
-// ════════════════════════════════════════════════════════════════════
+static void *metrics_writer(void *arg) {
+  MetricsState *ms = arg;
+  // Best effort: run only when a CPU would otherwise idle
+  struct sched_param sp = {.sched_priority = 0};
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+  const struct timespec nap = {.tv_sec = 0,
+                               .tv_nsec = METRICS_DRAIN_MS * 1000000L};
+  for (;;) {
+    bool quit = atomic_load_explicit(&ms->quit, memory_order_acquire);
+    metrics_drain(ms);
+    if (quit)
+      break;
+    nanosleep(&nap, NULL);
+  }
+  if (ms->aggregate) {
+    metrics_emit_window(
+        ms, atomic_load_explicit(&ms->dropped, memory_order_relaxed));
+    metrics_flush(ms);
+  }
+  return NULL;
+}
 
-static void handle_sigwinch(int sig) {
-  (void)sig;
-  g_resized = 1;
+/// Open the output for appending and start the writer thread.
+static void metrics_start(MetricsState *ms, const char *path, bool aggregate) {
+  ms->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (ms->fd < 0)
+    die("cannot open metrics output '%s': %s", path, strerror(errno));
+  ms->aggregate = aggregate;
+  atomic_init(&ms->head, 0);
+  atomic_init(&ms->tail, 0);
+  atomic_init(&ms->dropped, 0);
+  atomic_init(&ms->quit, false);
+  if (pthread_create(&ms->thread, NULL, metrics_writer, ms) != 0)
+    die("cannot start metrics writer thread");
+  ms->running = true;
 }
 
-static void handle_sigint(int sig) {
-  (void)sig;
-  g_quit = 1;
+/// Write out every pending record and stop the writer.
+static void metrics_stop(MetricsState *ms) {
+  if (!ms->running)
+    return;
+  atomic_store_explicit(&ms->quit, true, memory_order_release);
+  pthread_join(ms->thread, NULL);
+  ms->running = false;
+  close(ms->fd);
+  ms->fd = -1;
 }
 
 // ════════════════════════════════════════════════════════════════════
-//  Terminal cleanup (called from main, not from signal handler)
+//  Prometheus endpoint (--metrics-listen)
 // ════════════════════════════════════════════════════════════════════
+//
+// Counters and a frame-time histogram in the Prometheus text format,
+// served over plain HTTP on a TCP port or a Unix socket. There is no
+// server thread: once per frame the loop accepts whatever is waiting and
+// moves each open connection along with non-blocking calls, so a scrape
+// costs a few syscalls on the frame it lands on and nothing otherwise.
 
-static void cleanup_terminal(void) {
-  // Show cursor, reset attributes
-  const char restore[] = "\033[?25h\033[0m\n";
-  (void)write(STDOUT_FILENO, restore, sizeof(restore) - 1);
+// Histogram bounds in µs: 1 and 2 ms, then a frame at 240, 120, 60 and
+// 30 fps, 15 fps and 4 fps
+static const uint32_t prom_bounds_us[PROM_BUCKETS] = {
+    1000, 2000, 4167, 8333, 16667, 33333, 66667, 250000};
+
+static int prom_listen_unix(PromState *ps, const char *path) {
+  struct sockaddr_un sa = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(sa.sun_path))
+    die("socket path '%s' is too long", path);
+  strcpy(sa.sun_path, path);
+  // A socket file left behind by an earlier run would fail the bind
+  struct stat st;
+  if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 ||
+      listen(fd, PROM_MAX_CLIENTS) != 0)
+    die("cannot listen on '%s': %s", path, strerror(errno));
+  ps->unix_path = path;
+  return fd;
 }
 
-static void cleanup_resources(void) {
-  free(g_frame_buf);
-  g_frame_buf = NULL;
-  free(g_fb);
-  g_fb = NULL;
-  free(g_fbval);
-  g_fbval = NULL;
-  free(g_waves);
-  g_waves = NULL;
-  free(g_phase);
-  g_phase = NULL;
+/// Bind and listen on one TCP address; -1 with `*err` set on failure.
+static int prom_bind_tcp(const struct sockaddr *sa, socklen_t sa_len,
+                         int *err) {
+  int fd = socket(sa->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                  0);
+  if (fd < 0) {
+    *err = errno;
+    return -1;
+  }
+  const int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(fd, sa, sa_len) != 0 || listen(fd, PROM_MAX_CLIENTS) != 0) {
+    *err = errno;
+    close(fd);
+    return -1;
+  }
+  return fd;
 }
 
-// ════════════════════════════════════════════════════════════════════
-//  256-color palette functions
-// ════════════════════════════════════════════════════════════════════
+/// Listen on host:port, where host may be empty (all interfaces), a
+/// numeric IPv4 or bracketed IPv6 address, or a name. Only names go
+/// through getaddrinfo(), which `make static` leaves out (WAVE_NO_RESOLVER)
+/// because it needs the shared C library's NSS modules at run time.
+static int prom_listen_tcp(const char *addr) {
+  const char *colon = strrchr(addr, ':');
+  char *end;
+  errno = 0;
+  long port = colon ? strtol(colon + 1, &end, 10) : -1;
+  if (!colon || !colon[1] || *end || errno || port < 0 || port > 65535)
+    die("invalid --metrics-listen address '%s' (want host:port or a "
+        "socket path)",
+        addr);
+  char host[256];
+  const char *h = addr;
+  size_t len = (size_t)(colon - addr);
+  if (len >= 2 && h[0] == '[' && h[len - 1] == ']') {
+    h++;
+    len -= 2;
+  }
+  if (len >= sizeof(host))
+    die("invalid --metrics-listen host in '%s'", addr);
+  memcpy(host, h, len);
+  host[len] = '\0';
 
-static inline int clamp6(int v) { return v < 0 ? 0 : (v > 5 ? 5 : v); }
+  struct sockaddr_in sin = {.sin_family = AF_INET,
+                            .sin_port = htons((uint16_t)port),
+                            .sin_addr.s_addr = htonl(INADDR_ANY)};
+  struct sockaddr_in6 sin6 = {.sin6_family = AF_INET6,
+                              .sin6_port = htons((uint16_t)port)};
+  int fd = -1, err = 0;
+  if (!len || inet_pton(AF_INET, host, &sin.sin_addr) == 1)
+    fd = prom_bind_tcp((struct sockaddr *)&sin, sizeof(sin), &err);
+  else if (inet_pton(AF_INET6, host, &sin6.sin6_addr) == 1)
+    fd = prom_bind_tcp((struct sockaddr *)&sin6, sizeof(sin6), &err);
+  else {
+#ifdef WAVE_NO_RESOLVER
+    die("cannot resolve '%s': this build takes numeric addresses only "
+        "(built with make static)",
+        host);
+#else
+    const struct addrinfo hints = {.ai_family = AF_UNSPEC,
+                                   .ai_socktype = SOCK_STREAM,
+                                   .ai_flags = AI_PASSIVE | AI_NUMERICSERV};
+    struct addrinfo *res;
+    int rc = getaddrinfo(host, colon + 1, &hints, &res);
+    if (rc != 0)
+      die("cannot resolve '%s': %s", host, gai_strerror(rc));
+    for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next)
+      fd = prom_bind_tcp(ai->ai_addr, ai->ai_addrlen, &err);
+    freeaddrinfo(res);
+#endif
+  }
+  if (fd < 0)
+    die("cannot listen on '%s': %s", addr, strerror(err));
+  return fd;
+}
 
-/// Map r,g,b [0-5] to 256-color cube index.
-static inline int cube(int r, int g, int b) {
-  return 16 + 36 * clamp6(r) + 6 * clamp6(g) + clamp6(b);
+/// Open the listening socket: a value containing '/' is a Unix socket
+/// path, anything else host:port.
+static void prom_start(PromState *ps, const char *addr, int fps,
+                       int frame_delay) {
+  for (int i = 0; i < PROM_MAX_CLIENTS; i++)
+    ps->clients[i].fd = -1;
+  ps->fd = strchr(addr, '/') ? prom_listen_unix(ps, addr)
+                             : prom_listen_tcp(addr);
+  ps->target_fps = fps;
+  ps->stall_us = (uint32_t)frame_delay / 4;
 }
 
-static int pal_rainbow(double t) {
-  int r = (int)(2.5 + 2.5 * sin(TWO_PI * t));
-  int g = (int)(2.5 + 2.5 * sin(TWO_PI * t + 2.094));
-  int b = (int)(2.5 + 2.5 * sin(TWO_PI * t + 4.189));
-  return cube(r, g, b);
+/// Count a finished frame.
+static void prom_record(PromState *ps, const FrameRecord *rec) {
+  uint32_t work_us = 0;
+  for (int s = 0; s < STAGE_COUNT; s++)
+    work_us += rec->stage_us[s];
+  int b = 0;
+  while (b < PROM_BUCKETS && work_us > prom_bounds_us[b])
+    b++;
+  ps->bucket[b]++;
+  ps->frame_us_sum += work_us;
+  ps->frames++;
+  ps->bytes += rec->bytes;
+  ps->stalls += rec->stage_us[STAGE_WRITE] > ps->stall_us;
+  ps->dropped += rec->missed;
+
+  if (ps->fps_frames++ == 0)
+    ps->fps_start_us = rec->start_us;
+  const uint64_t span = rec->start_us - ps->fps_start_us;
+  if (span >= 1000000) {
+    ps->fps = (double)(ps->fps_frames - 1) * 1e6 / (double)span;
+    ps->fps_frames = 1;
+    ps->fps_start_us = rec->start_us;
+  }
 }
 
-static int pal_dracula(double t) {
-  int r = (int)(2.0 + 3.0 * sin(TWO_PI * t + 0.5));
-  int g = (int)(1.0 + 2.0 * sin(TWO_PI * t + 3.5));
-  int b = (int)(3.0 + 2.0 * sin(TWO_PI * t + 1.2));
-  return cube(r, g, b);
+/// Append to a fixed buffer, truncating quietly if it is full.
+static void prom_printf(char *buf, size_t cap, size_t *len, const char *fmt,
+                        ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf + *len, cap - *len, fmt, ap);
+  va_end(ap);
+  if (n > 0)
+    *len = (size_t)n < cap - *len ? *len + (size_t)n : cap - 1;
 }
 
-static int pal_ocean(double t) {
-  int r = (int)(0.5 + 1.5 * sin(TWO_PI * t + 4.0));
-  int g = (int)(2.0 + 2.5 * sin(TWO_PI * t + 1.0));
-  int b = (int)(3.5 + 1.5 * sin(TWO_PI * t));
-  return cube(r, g, b);
+static void prom_counter(char *buf, size_t cap, size_t *len,
+                         const char *name, const char *help, uint64_t v) {
+  prom_printf(buf, cap, len,
+              "# HELP %s %s\n# TYPE %s counter\n%s %" PRIu64 "\n", name,
+              help, name, name, v);
 }
 
-static int pal_fire(double t) {
-  int r = (int)(3.5 + 1.5 * sin(TWO_PI * t));
-  int g = (int)(1.5 + 2.0 * sin(TWO_PI * t + 0.8));
-  int b = (int)(0.5 + 0.5 * sin(TWO_PI * t + 1.6));
-  return cube(r, g, b);
+static void prom_gauge(char *buf, size_t cap, size_t *len, const char *name,
+                       const char *help, double v) {
+  prom_printf(buf, cap, len, "# HELP %s %s\n# TYPE %s gauge\n%s %.6g\n",
+              name, help, name, name, v);
 }
 
-static int pal_pastel(double t) {
-  int r = (int)(3.5 + 1.5 * sin(TWO_PI * t));
-  int g = (int)(3.0 + 1.5 * sin(TWO_PI * t + 2.094));
-  int b = (int)(3.5 + 1.5 * sin(TWO_PI * t + 4.189));
-  return cube(r, g, b);
+/// Render the current values in the text exposition format.
+static size_t prom_format(const PromState *ps, char *buf, size_t cap) {
+  size_t len = 0;
+  prom_counter(buf, cap, &len, "wave_frames_total", "Frames rendered.",
+               ps->frames);
+  prom_counter(buf, cap, &len, "wave_bytes_written_total",
+               "Bytes written to the terminal.", ps->bytes);
+  prom_counter(buf, cap, &len, "wave_write_stalls_total",
+               "Frame writes that took over a quarter of the frame "
+               "interval.",
+               ps->stalls);
+  prom_counter(buf, cap, &len, "wave_dropped_frames_total",
+               "Frames whose work overran the frame interval.",
+               ps->dropped);
+  prom_printf(buf, cap, &len,
+              "# HELP wave_frame_seconds Time from clearing the grid to "
+              "the end of the write.\n"
+              "# TYPE wave_frame_seconds histogram\n");
+  uint64_t cum = 0;
+  for (int b = 0; b < PROM_BUCKETS; b++) {
+    cum += ps->bucket[b];
+    prom_printf(buf, cap, &len,
+                "wave_frame_seconds_bucket{le=\"%g\"} %" PRIu64 "\n",
+                prom_bounds_us[b] / 1e6, cum);
+  }
+  prom_printf(buf, cap, &len,
+              "wave_frame_seconds_bucket{le=\"+Inf\"} %" PRIu64 "\n"
+              "wave_frame_seconds_sum %.6f\n"
+              "wave_frame_seconds_count %" PRIu64 "\n",
+              ps->frames, ps->frame_us_sum / 1e6, ps->frames);
+  prom_gauge(buf, cap, &len, "wave_fps",
+             "Frames per second over the last full second.", ps->fps);
+  prom_gauge(buf, cap, &len, "wave_target_fps", "Configured frame rate.",
+             ps->target_fps);
+  return len;
 }
 
-static int pal_neon(double t) {
-  int r = (int)(2.5 + 2.5 * sin(TWO_PI * t));
-  int g = (int)(1.0 + 4.0 * sin(TWO_PI * t + 2.5));
-  int b = (int)(2.0 + 3.0 * sin(TWO_PI * t + 4.8));
-  return cube(r, g, b);
+/// Answer a complete request: the metrics for GET / or /metrics.
+static void prom_respond(PromState *ps, PromClient *c) {
+  const bool found = !strncmp(c->req, "GET /metrics ", 13) ||
+                     !strncmp(c->req, "GET / ", 6);
+  size_t body_len = 0;
+  const char *status = "404 Not Found";
+  if (found) {
+    // Leave room for the headers in front of the body
+    body_len = prom_format(ps, ps->body, sizeof(ps->body) - 128);
+    status = "200 OK";
+  }
+  int n = snprintf(c->out, sizeof(c->out),
+                   "HTTP/1.0 %s\r\n"
+                   "Content-Type: text/plain; version=0.0.4\r\n"
+                   "Content-Length: %zu\r\n"
+                   "Connection: close\r\n\r\n",
+                   status, body_len);
+  memcpy(c->out + n, ps->body, body_len);
+  c->out_len = (size_t)n + body_len;
+  c->out_off = 0;
 }
 
-static int pal_aurora(double t) {
-  int r = (int)(1.0 + 2.0 * sin(TWO_PI * t + 3.8));
-  int g = (int)(3.0 + 2.0 * sin(TWO_PI * t));
-  int b = (int)(2.0 + 2.5 * sin(TWO_PI * t + 1.8));
-  return cube(r, g, b);
+static void prom_close(PromClient *c) {
+  close(c->fd);
+  c->fd = -1;
 }
 
-static int pal_matrix(double t) {
-  int g = (int)(1.5 + 3.5 * sin(TWO_PI * t));
-  return cube(0, g, 0);
+static bool prom_would_block(void) {
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
 }
 
-static const Palette palettes[] = {
-    {"rainbow", pal_rainbow}, {"dracula", pal_dracula}, {"ocean", pal_ocean},
-    {"fire", pal_fire},       {"pastel", pal_pastel},   {"neon", pal_neon},
-    {"aurora", pal_aurora},   {"matrix", pal_matrix},
-};
-static const int NUM_PALETTES = (int)(sizeof(palettes) / sizeof(palettes[0]));
+/// Read whatever part of the request has arrived; answer it once the
+/// headers are complete.
+static void prom_read(PromState *ps, PromClient *c) {
+  ssize_t n = recv(c->fd, c->req + c->req_len,
+                   sizeof(c->req) - 1 - c->req_len, 0);
+  if (n == 0 || (n < 0 && !prom_would_block())) {
+    prom_close(c);
+    return;
+  }
+  if (n > 0)
+    c->req_len += (size_t)n;
+  c->req[c->req_len] = '\0';
+  if (strstr(c->req, "\r\n\r\n") || strstr(c->req, "\n\n"))
+    prom_respond(ps, c);
+  else if (c->req_len == sizeof(c->req) - 1)
+    prom_close(c); // headers too large for a scrape
+}
 
-static palette_fn find_palette(const char *name) {
-  for (int i = 0; i < NUM_PALETTES; i++) {
-    if (strcasecmp(palettes[i].name, name) == 0)
-      return palettes[i].fn;
+/// One turn of the server, called once per frame. Never blocks.
+static void prom_serve(PromState *ps, uint64_t now_us) {
+  for (;;) {
+    int fd = accept4(ps->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+      break;
+    PromClient *c = NULL;
+    for (int i = 0; i < PROM_MAX_CLIENTS && !c; i++)
+      if (ps->clients[i].fd < 0)
+        c = &ps->clients[i];
+    if (!c) {
+      close(fd); // every slot busy; the scraper will retry
+      continue;
+    }
+    *c = (PromClient){.fd = fd, .since_us = now_us};
+  }
+  for (int i = 0; i < PROM_MAX_CLIENTS; i++) {
+    PromClient *c = &ps->clients[i];
+    if (c->fd < 0)
+      continue;
+    if (now_us - c->since_us > PROM_CLIENT_TIMEOUT) {
+      prom_close(c);
+      continue;
+    }
+    if (!c->out_len)
+      prom_read(ps, c);
+    if (c->fd < 0 || !c->out_len)
+      continue;
+    ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off,
+                     MSG_NOSIGNAL);
+    if (n > 0)
+      c->out_off += (size_t)n;
+    if (c->out_off == c->out_len || (n < 0 && !prom_would_block()))
+      prom_close(c);
   }
-  return NULL;
+}
+
+static void prom_stop(PromState *ps) {
+  if (ps->fd < 0)
+    return;
+  for (int i = 0; i < PROM_MAX_CLIENTS; i++)
+    if (ps->clients[i].fd >= 0)
+      prom_close(&ps->clients[i]);
+  close(ps->fd);
+  ps->fd = -1;
+  if (ps->unix_path)
+    unlink(ps->unix_path);
 }
 
 // ════════════════════════════════════════════════════════════════════
-//  Wave generation helpers
+//  Real-time mode (--realtime)
 // ════════════════════════════════════════════════════════════════════
+//
+// Frames are paced against absolute deadlines with clock_nanosleep()
+// instead of a relative usleep(), so time spent on a frame does not push
+// every later frame back, and each wake-up's lateness goes into a
+// histogram. On request the render thread also asks for SCHED_FIFO, is
+// pinned to one CPU and locks its memory, with the frame buffer faulted
+// in up front. Each of these is best effort: what the system refuses is
+// noted for the exit report and the animation carries on without it.
 
-static const char *default_glyphs[] = {"█", "▓", "░", "●", "◆",
-                                       "╳", "◈", "▪", "⬡", "✦"};
-static const int NUM_DEFAULT_GLYPHS = 10;
+// Histogram bounds in µs
+static const uint32_t rt_bounds_us[REALTIME_BUCKETS] = {
+    10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000};
 
-static void generate_waves(Wave *waves, int n, const char *glyph_override) {
-  for (int i = 0; i < n; i++) {
-    double t = (double)i / (n > 1 ? (n - 1) : 1);
-    waves[i].freq = 0.06 + 0.10 * t;
-    waves[i].amp = 0.85 - 0.50 * t;
-    waves[i].phase_spd = 0.030 + 0.055 * t;
-    waves[i].glyph = glyph_override ? glyph_override
-                                    : default_glyphs[i % NUM_DEFAULT_GLYPHS];
+static void rt_note(RealtimeState *rt, const char *fmt, ...) {
+  size_t len = strlen(rt->granted);
+  if (len && len + 2 < sizeof(rt->granted)) {
+    memcpy(rt->granted + len, ", ", 3);
+    len += 2;
+  }
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(rt->granted + len, sizeof(rt->granted) - len, fmt, ap);
+  va_end(ap);
+}
+
+/// Apply what --realtime asked for. Call once the frame buffer and the
+/// context (see realtime_grow()) are sized for the first frame.
+static void realtime_start(RealtimeState *rt, const WaveConfig *cfg) {
+  if (cfg->rt_fifo) {
+    struct sched_param sp = {.sched_priority = REALTIME_PRIORITY};
+    if (sched_setscheduler(0, SCHED_FIFO, &sp) == 0)
+      rt_note(rt, "SCHED_FIFO %d", REALTIME_PRIORITY);
+    else
+      rt_note(rt, "no SCHED_FIFO (%s)", strerror(errno));
+  }
+  if (cfg->rt_cpu != -2) {
+    int cpu = cfg->rt_cpu >= 0 ? cfg->rt_cpu : sched_getcpu();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cpu >= 0 && cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+    if (cpu >= 0 && sched_setaffinity(0, sizeof(set), &set) == 0)
+      rt_note(rt, "pinned to CPU %d", cpu);
+    else
+      rt_note(rt, "not pinned (%s)", cpu < 0 ? "no CPU" : strerror(errno));
+  }
+  if (cfg->rt_lock) {
+    // Locking future mappings under a finite RLIMIT_MEMLOCK would make
+    // a later allocation (a resize) fail, so only do it without a limit
+    struct rlimit rl;
+    rt->lock_future = geteuid() == 0 ||
+                      (getrlimit(RLIMIT_MEMLOCK, &rl) == 0 &&
+                       rl.rlim_cur == RLIM_INFINITY);
+    rt->locked =
+        mlockall(MCL_CURRENT | (rt->lock_future ? MCL_FUTURE : 0)) == 0;
+    if (rt->locked)
+      rt_note(rt, "memory locked%s", rt->lock_future ? "" : " (current)");
+    else {
+      rt_note(rt, "memory not locked (%s)", strerror(errno));
+      rt->lock_future = false;
+    }
+  }
+  rt->next_us = mono_us();
+}
+
+/// Run the context through a frame of rows x cols at time t without
+/// drawing it. The grid, scratch, simulation and plot buffers that
+/// wave_ctx_begin() and wave_ctx_plot() allocate on first use then exist
+/// before memory is locked, and are locked with it.
+static void realtime_grow(WaveCtx *ctx, int rows, int cols, double t,
+                          size_t ys_arrays) {
+  if (!wave_ctx_begin(ctx, rows, cols, t) ||
+      !wave_ctx_scratch(ctx, ys_arrays) || !wave_ctx_plot(ctx))
+    die_oom("frame grid");
+}
+
+/// Touch every page of a fresh frame buffer so the first frame drawn
+/// into it does not take the page faults. Without MCL_FUTURE, lock
+/// what is mapped now again, after realtime_grow() has resized the
+/// context; pages that are already locked are not counted twice
+/// against RLIMIT_MEMLOCK.
+static void realtime_prefault(RealtimeState *rt, char *buf, size_t cap) {
+  memset(buf, 0, cap);
+  if (rt->locked && !rt->lock_future && mlockall(MCL_CURRENT) != 0) {
+    rt->locked = false;
+    rt_note(rt, "resized frame buffer not locked (%s)", strerror(errno));
+  }
+}
+
+/// Sleep until the next frame is due and record how late we woke.
+static void realtime_wait(RealtimeState *rt, int frame_delay) {
+  rt->next_us += (uint64_t)frame_delay;
+  uint64_t now = mono_us();
+  // More than a frame behind: start a new schedule rather than race to
+  // catch up, and always sleep so a SCHED_FIFO thread yields the CPU
+  if (now > rt->next_us + (uint64_t)frame_delay) {
+    rt->overruns++;
+    rt->next_us = now + (uint64_t)frame_delay;
+  }
+  const struct timespec due = {.tv_sec = (time_t)(rt->next_us / 1000000u),
+                               .tv_nsec = (long)(rt->next_us % 1000000u) *
+                                          1000L};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) ==
+             EINTR &&
+         !g_quit)
+    ;
+  now = mono_us();
+  uint64_t late = now > rt->next_us ? now - rt->next_us : 0;
+  int b = 0;
+  while (b < REALTIME_BUCKETS && late >= rt_bounds_us[b])
+    b++;
+  rt->hist[b]++;
+  rt->frames++;
+  rt->late_sum_us += late;
+  if (rt->late_max_us < late)
+    rt->late_max_us = late;
+}
+
+/// Print what was granted and the frame-start jitter histogram.
+static void realtime_report(const RealtimeState *rt) {
+  fprintf(stderr, "wave: realtime: %s\n",
+          rt->granted[0] ? rt->granted : "deadline pacing only");
+  if (!rt->frames)
+    return;
+  fprintf(stderr,
+          "wave: frame-start jitter over %" PRIu64 " frames: mean %.1f us, "
+          "max %" PRIu64 " us, %" PRIu64 " overruns\n",
+          rt->frames, (double)rt->late_sum_us / rt->frames, rt->late_max_us,
+          rt->overruns);
+  uint64_t peak = 1;
+  for (int b = 0; b <= REALTIME_BUCKETS; b++)
+    if (peak < rt->hist[b])
+      peak = rt->hist[b];
+  for (int b = 0; b <= REALTIME_BUCKETS; b++) {
+    if (b < REALTIME_BUCKETS)
+      fprintf(stderr, "  < %5" PRIu32 " us %8" PRIu64 " ", rt_bounds_us[b],
+              rt->hist[b]);
+    else
+      fprintf(stderr, " >= %5" PRIu32 " us %8" PRIu64 " ",
+              rt_bounds_us[b - 1], rt->hist[b]);
+    for (uint64_t i = 0; i < rt->hist[b] * 40 / peak; i++)
+      fputc('#', stderr);
+    fputc('\n', stderr);
   }
 }
 
 // ════════════════════════════════════════════════════════════════════
-//  Terminal helpers
+//  Single-frame mode (--once)
 // ════════════════════════════════════════════════════════════════════
+//
+// Built for shell prompts and status bars: one frame whose phase comes
+// from the wall clock, so consecutive calls still animate. No signal
+// handlers, no heap and, with --size, no terminal query — every buffer
+// is on the stack and the frame leaves in a single write().
 
-static void term_size(int *rows, int *cols) {
-  struct winsize w;
-  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0 && w.ws_row > 0 &&
-      w.ws_col > 0) {
-    *rows = w.ws_row;
-    *cols = w.ws_col;
-  } else {
-    *rows = 24;
-    *cols = 80;
+/// Render the wall-clock frame and return the process exit code.
+static int render_once(const WaveConfig *cfg, const unsigned char *lut) {
+  int rows = cfg->size_rows, cols = cfg->size_cols;
+  if (!rows)
+    term_size(&rows, &cols);
+  if (cols > ONCE_MAX_CELLS)
+    cols = ONCE_MAX_CELLS;
+  if ((size_t)rows * (size_t)cols > ONCE_MAX_CELLS)
+    rows = ONCE_MAX_CELLS / cols;
+
+  static Wave waves[MAX_WAVES]; // too large for the stack
+  int owner[ONCE_MAX_CELLS];
+  double val[ONCE_MAX_CELLS];
+  double ys[ONCE_MAX_CELLS];
+  double sum[ONCE_MAX_CELLS] = {0};
+  double power = 0.0;
+  char out[ONCE_MAX_CELLS * WAVE_MAX_BYTES_PER_CELL];
+  WaveGrid grid = {rows, cols, owner, val};
+  wave_columns_fn columns = wave_find_generator(cfg->generator);
+  WaveFormula formula;
+  if (cfg->formula)
+    wave_formula_compile(&formula, cfg->formula, NULL, 0); // checked already
+  wave_generate(waves, cfg->num_waves, cfg->glyph);
+  apply_wave_specs(cfg, waves, cfg->num_waves);
+
+  // Frames elapsed since the epoch at the configured rate, folded into
+  // a range where sin() keeps full precision
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  double frame =
+      fmod((double)now.tv_sec * cfg->fps, ONCE_FRAME_PERIOD) +
+      (double)now.tv_nsec * 1e-9 * cfg->fps;
+
+  wave_grid_clear(&grid);
+  const int mid_y = rows / 2;
+  const double color_base = frame / WAVE_COLOR_PERIOD;
+  for (int w = 0; w < cfg->num_waves; w++) {
+    double phase = fmod(waves[w].phase_spd * cfg->speed_mult * frame, TWO_PI);
+    if (cfg->noise) {
+      wave_column_simplex(&waves[w], w,
+                          waves[w].phase_spd * cfg->speed_mult * frame,
+                          WAVE_NOISE_OCTAVES, cols, ys);
+    } else if (cfg->formula) {
+      const WaveFormulaVars vars = {frame / cfg->fps * cfg->speed_mult, w,
+                                    cfg->num_waves, waves[w].freq, phase};
+      wave_formula_eval(&formula, &vars, cols, ys);
+    } else {
+      columns(&waves[w], phase, cols, ys);
+    }
+    if (cfg->superpose) {
+      wave_superpose_add(sum, ys, waves[w].amp, cols);
+      power += waves[w].amp * waves[w].amp;
+      continue;
+    }
+    // A one-line frame has no vertical room: keep the glyphs on it
+    double scale = rows > 1 ? waves[w].amp * mid_y : 0.0;
+    wave_plot_column(&grid, w, ys, mid_y, scale, color_base);
   }
+  if (cfg->superpose) {
+    wave_superpose_norm(sum, power, cols);
+    if (cfg->superpose == WAVE_SUPERPOSE_INTENSITY)
+      wave_plot_intensity(&grid, 0, sum, color_base);
+    else
+      wave_plot_column(&grid, 0, sum, mid_y, mid_y, color_base);
+  }
+
+  unsigned int rng = (unsigned int)now.tv_sec | 1u;
+  size_t pos = wave_encode(&grid, waves, lut, &rng, 0, out, sizeof(out));
+  return write(STDOUT_FILENO, out, pos) == (ssize_t)pos ? EXIT_OK : EXIT_ERR;
 }
 
 // ════════════════════════════════════════════════════════════════════
@@ -365,7 +3347,9 @@ static void print_help(void) {
   printf("┘\033[0m\n\n");
 
   printf("\033[1mUSAGE\033[0m\n"
-         "  \033[38;5;248m$\033[0m wave \033[38;5;114m[OPTIONS]\033[0m\n\n"
+         "  \033[38;5;248m$\033[0m wave \033[38;5;114m[OPTIONS]\033[0m\n"
+         "  \033[38;5;248m$\033[0m wave \033[38;5;114m[OPTIONS]\033[0m -- "
+         "\033[38;5;248m<command> [args...]\033[0m\n\n"
 
          "\033[1mOPTIONS\033[0m\n"
          "  \033[38;5;114m-s, --speed\033[0m \033[38;5;248m<float>\033[0m   "
@@ -380,27 +3364,119 @@ static void print_help(void) {
          "  \033[38;5;114m-g, --char\033[0m  \033[38;5;248m<str>\033[0m     "
          "Wave glyph character      "
          "\033[2m[default: auto]\033[0m\n"
+         "      \033[38;5;114m--generator\033[0m \033[38;5;248m<gen>\033[0m "
+         "Wave shape kernel         "
+         "\033[2m[default: shape]\033[0m\n"
+         "      \033[38;5;114m--formula\033[0m \033[38;5;248m<expr>\033[0m  "
+         "Wave shape as f(x, t, i)  "
+         "\033[2m[e.g. sin(x*f+p)]\033[0m\n"
+         "      \033[38;5;114m--noise\033[0m           "
+         "Simplex noise waves       "
+         "\033[2m[organic water]\033[0m\n"
+         "      \033[38;5;114m--superpose\033[0m\033[38;5;248m[=how]\033[0m "
+         "Sum waves (interference)  "
+         "\033[2m[line or intensity]\033[0m\n"
+         "      \033[38;5;114m--physics\033[0m\033[38;5;248m[=n]\033[0m     "
+         "Damped string, n drops/s  "
+         "\033[2m[keys: space, 1-9]\033[0m\n"
+         "      \033[38;5;114m--ripple\033[0m\033[38;5;248m[=n]\033[0m      "
+         "2D ripple tank, n drops/s "
+         "\033[2m[click or drag]\033[0m\n"
+         "      \033[38;5;114m--3d\033[0m              "
+         "Ocean in perspective      "
+         "\033[2m[waves to horizon]\033[0m\n"
+         "      \033[38;5;114m--threads\033[0m \033[38;5;248m<n>\033[0m     "
+         "Threads for --ripple/--3d "
+         "\033[2m[default: all CPUs]\033[0m\n"
+         "      \033[38;5;114m--foam\033[0m\033[38;5;248m[=n]\033[0m        "
+         "Foam spray, n particles   "
+         "\033[2m[default: %d]\033[0m\n"
+         "      \033[38;5;114m--shape\033[0m \033[38;5;248m<name>\033[0m    "
+         "Base shape for all waves  "
+         "\033[2m[default: sine]\033[0m\n"
+         "      \033[38;5;114m--wave\033[0m \033[38;5;248m<spec>\033[0m     "
+         "Shape/params of next wave "
+         "\033[2m[e.g. saw:amp=0.5]\033[0m\n"
+         "      \033[38;5;114m--plugin\033[0m \033[38;5;248m<path>\033[0m   "
+         "Load palettes/generators  "
+         "\033[2m[shared object]\033[0m\n"
          "  \033[38;5;114m-n, --waves\033[0m \033[38;5;248m<int>\033[0m     "
          "Number of waves           "
          "\033[2m[default: %d]\033[0m\n"
+         "  \033[38;5;114m-a, --audio\033[0m \033[38;5;248m<path>\033[0m    "
+         "React to S16LE mono PCM   "
+         "\033[2m[- = stdin]\033[0m\n"
+         "      \033[38;5;114m--audio-rate\033[0m \033[38;5;248m<hz>\033[0m "
+         "PCM sample rate           "
+         "\033[2m[default: %d]\033[0m\n"
+         "  \033[38;5;114m-S, --stream\033[0m          "
+         "Plot numbers from stdin   "
+         "\033[2m[one sample per line]\033[0m\n"
+         "  \033[38;5;114m-F, --file\033[0m  \033[38;5;248m<path>\033[0m    "
+         "View float32 or CSV file  "
+         "\033[2m[arrows pan/zoom]\033[0m\n"
+         "      \033[38;5;114m--channels\033[0m \033[38;5;248m<int>\033[0m  "
+         "Series in a raw file      "
+         "\033[2m[default: 1]\033[0m\n"
+         "  \033[38;5;114m-M, --sys\033[0m             "
+         "CPU, net and disk load    "
+         "\033[2m[one wave per metric]\033[0m\n"
+         "      \033[38;5;114m--interval\033[0m \033[38;5;248m<ms>\033[0m   "
+         "Metric sampling period    "
+         "\033[2m[default: %d]\033[0m\n"
+         "  \033[38;5;114m-P, --pv\033[0m              "
+         "Pass stdin to stdout      "
+         "\033[2m[throughput on tty]\033[0m\n"
+         "      \033[38;5;114m--progress\033[0m\033[38;5;248m[=fd]\033[0m   "
+         "Fill level from N%% or a/b "
+         "\033[2m[default fd: 0]\033[0m\n"
+         "      \033[38;5;114m--once\033[0m            "
+         "Print one frame and exit  "
+         "\033[2m[for prompts]\033[0m\n"
+         "      \033[38;5;114m--size\033[0m \033[38;5;248m<WxH>\033[0m      "
+         "Frame size for --once     "
+         "\033[2m[default: terminal]\033[0m\n"
+         "  \033[38;5;114m-H, --height\033[0m \033[38;5;248m<int>\033[0m    "
+         "Draw inline in N lines    "
+         "\033[2m[default: full screen]\033[0m\n"
+         "      \033[38;5;114m--metrics-out\033[0m \033[38;5;248m<f>\033[0m "
+         "Append frame stats to f   "
+         "\033[2m[JSON lines]\033[0m\n"
+         "      \033[38;5;114m--metrics-per-sec\033[0m "
+         "One metrics line a second "
+         "\033[2m[avg and max]\033[0m\n"
+         "      \033[38;5;114m--metrics-listen\033[0m "
+         "\033[38;5;248m<a>\033[0m Prometheus endpoint    "
+         "\033[2m[host:port or path]\033[0m\n"
+         "      \033[38;5;114m--perf-counters\033[0m   "
+         "IPC and misses per stage  "
+         "\033[2m[HUD and exit report]\033[0m\n"
+         "      \033[38;5;114m--trace\033[0m \033[38;5;248m<f>\033[0m       "
+         "Write a frame trace to f  "
+         "\033[2m[Chrome trace JSON]\033[0m\n"
+         "      \033[38;5;114m--realtime\033[0m\033[38;5;248m[=opts]\033[0m "
+         "Deadline pacing, jitter   "
+         "\033[2m[fifo,pin[=cpu],lock]\033[0m\n"
          "  \033[38;5;114m-v, --version\033[0m         "
          "Print version\n"
          "  \033[38;5;114m-h, --help\033[0m            "
          "Show this help\n\n",
-         DEFAULT_SPEED, DEFAULT_FPS, DEFAULT_PALETTE, DEFAULT_NUM_WAVES);
+         DEFAULT_SPEED, DEFAULT_FPS, DEFAULT_PALETTE, FOAM_DEFAULT_PARTICLES,
+         DEFAULT_NUM_WAVES, AUDIO_DEFAULT_RATE, SYS_DEFAULT_INTERVAL);
 
   // Palette showcase with color previews
   printf("\033[1mPALETTES\033[0m\n");
-  for (int i = 0; i < NUM_PALETTES; i++) {
+  const int num_palettes = wave_palette_count();
+  for (int i = 0; i < num_palettes; i++) {
+    const unsigned char *lut = wave_find_palette(wave_palette_name(i));
     printf("  ");
     // print 8 colored blocks as a mini gradient preview
     for (int s = 0; s < 8; s++) {
-      double t = (double)s / 7.0;
-      int c = palettes[i].fn(t);
+      int c = lut[s * (WAVE_LUT_SIZE - 1) / 7];
       printf("\033[38;5;%dm▄\033[0m", c);
     }
-    printf("  %-8s", palettes[i].name);
-    if ((i % 2) == 1 || i == NUM_PALETTES - 1)
+    printf("  %-8s", wave_palette_name(i));
+    if ((i % 2) == 1 || i == num_palettes - 1)
       putchar('\n');
   }
 
@@ -439,6 +3515,122 @@ static bool parse_long(const char *str, long *out) {
 //  CLI parsing
 // ════════════════════════════════════════════════════════════════════
 
+/// Parse --realtime[=fifo,pin[=cpu],lock|none]. Without a list, all of
+/// them are requested; "none" only paces and measures, for a baseline.
+static void parse_realtime(char *arg, WaveConfig *cfg) {
+  cfg->realtime = true;
+  if (!arg) {
+    cfg->rt_fifo = cfg->rt_lock = true;
+    cfg->rt_cpu = -1;
+    return;
+  }
+  char *save;
+  for (char *opt = strtok_r(arg, ",", &save); opt;
+       opt = strtok_r(NULL, ",", &save)) {
+    long cpu;
+    if (strcmp(opt, "fifo") == 0)
+      cfg->rt_fifo = true;
+    else if (strcmp(opt, "lock") == 0)
+      cfg->rt_lock = true;
+    else if (strcmp(opt, "pin") == 0)
+      cfg->rt_cpu = -1;
+    else if (strncmp(opt, "pin=", 4) == 0) {
+      if (!parse_long(opt + 4, &cpu) || cpu < 0 || cpu >= CPU_SETSIZE)
+        die("invalid CPU '%s' for --realtime pin", opt + 4);
+      cfg->rt_cpu = (int)cpu;
+    } else if (strcmp(opt, "none") != 0)
+      die("unknown --realtime option '%s' (fifo, pin[=cpu], lock, none)",
+          opt);
+  }
+}
+
+/// Parse a --wave spec "[shape][:key=value,...]". The argument is split
+/// in place so a glyph can point into it.
+static void parse_wave_spec(char *arg, WaveSpec *sp) {
+  char *params = strchr(arg, ':');
+  if (params)
+    *params++ = '\0';
+  if (*arg) {
+    int shape = wave_find_shape(arg);
+    if (shape < 0)
+      die("unknown wave shape '%s' (sine, square, triangle, saw, noise)",
+          arg);
+    sp->w.shape = shape;
+    sp->set |= SPEC_SHAPE;
+  }
+  char *save = NULL;
+  for (char *kv = params ? strtok_r(params, ",", &save) : NULL; kv;
+       kv = strtok_r(NULL, ",", &save)) {
+    char *val = strchr(kv, '=');
+    if (!val)
+      die("invalid wave parameter '%s' (expected key=value)", kv);
+    *val++ = '\0';
+    double d;
+    if (strcmp(kv, "freq") == 0) {
+      if (!parse_double(val, &d) || d <= 0.0)
+        die("invalid freq '%s' (must be a positive number)", val);
+      sp->w.freq = d;
+      sp->set |= SPEC_FREQ;
+    } else if (strcmp(kv, "amp") == 0) {
+      if (!parse_double(val, &d) || d < 0.0 || d > 1.0)
+        die("invalid amp '%s' (must be 0-1)", val);
+      sp->w.amp = d;
+      sp->set |= SPEC_AMP;
+    } else if (strcmp(kv, "speed") == 0) {
+      if (!parse_double(val, &d))
+        die("invalid speed '%s' (must be a number)", val);
+      sp->w.phase_spd = d;
+      sp->set |= SPEC_SPEED;
+    } else if (strcmp(kv, "harm") == 0) {
+      int n = 0;
+      char *hsave = NULL;
+      for (char *h = strtok_r(val, "/", &hsave); h;
+           h = strtok_r(NULL, "/", &hsave)) {
+        if (n == WAVE_MAX_HARMONICS)
+          die("at most %d harmonics per wave", WAVE_MAX_HARMONICS);
+        if (!parse_double(h, &d))
+          die("invalid harmonic weight '%s'", h);
+        sp->w.harmonics[n++] = d;
+      }
+      sp->w.num_harmonics = n;
+      sp->set |= SPEC_HARM;
+    } else if (strcmp(kv, "glyph") == 0 && *val) {
+      sp->w.glyph = val;
+      sp->set |= SPEC_GLYPH;
+    } else {
+      die("unknown wave parameter '%s' (freq, amp, speed, harm, glyph)", kv);
+    }
+  }
+}
+
+// Long-only options get codes outside the printable range
+enum {
+  OPT_AUDIO_RATE = 256,
+  OPT_CHANNELS,
+  OPT_INTERVAL,
+  OPT_PROGRESS,
+  OPT_ONCE,
+  OPT_SIZE,
+  OPT_PLUGIN,
+  OPT_GENERATOR,
+  OPT_FORMULA,
+  OPT_SHAPE,
+  OPT_WAVE,
+  OPT_NOISE,
+  OPT_SUPERPOSE,
+  OPT_PHYSICS,
+  OPT_RIPPLE,
+  OPT_THREADS,
+  OPT_FOAM,
+  OPT_3D,
+  OPT_METRICS_OUT,
+  OPT_METRICS_AGGREGATE,
+  OPT_METRICS_LISTEN,
+  OPT_PERF_COUNTERS,
+  OPT_TRACE,
+  OPT_REALTIME,
+};
+
 static WaveConfig parse_args(int argc, char **argv) {
   WaveConfig cfg = {
       .speed_mult = DEFAULT_SPEED,
@@ -446,6 +3638,42 @@ static WaveConfig parse_args(int argc, char **argv) {
       .num_waves = DEFAULT_NUM_WAVES,
       .color_name = DEFAULT_PALETTE,
       .glyph = NULL,
+      .audio_path = NULL,
+      .audio_rate = AUDIO_DEFAULT_RATE,
+      .stream = false,
+      .file_path = NULL,
+      .channels = 1,
+      .sys = false,
+      .sys_interval = SYS_DEFAULT_INTERVAL,
+      .pv = false,
+      .cmd_argv = NULL,
+      .height = 0,
+      .progress = false,
+      .progress_fd = STDIN_FILENO,
+      .once = false,
+      .size_cols = 0,
+      .size_rows = 0,
+      .generator = NULL,
+      .formula = NULL,
+      .noise = false,
+      .superpose = WAVE_SUPERPOSE_OFF,
+      .physics = false,
+      .impulse_rate = PHYSICS_DEFAULT_RATE,
+      .ripple = false,
+      .ocean = false,
+      .threads = 0,
+      .foam = 0,
+      .shape = -1,
+      .num_specs = 0,
+      .metrics_path = NULL,
+      .metrics_aggregate = false,
+      .metrics_listen = NULL,
+      .perf_counters = false,
+      .trace_path = NULL,
+      .realtime = false,
+      .rt_fifo = false,
+      .rt_lock = false,
+      .rt_cpu = -2,
   };
 
   static struct option long_opts[] = {
@@ -454,13 +3682,43 @@ static WaveConfig parse_args(int argc, char **argv) {
       {"color", required_argument, NULL, 'c'},
       {"char", required_argument, NULL, 'g'},
       {"waves", required_argument, NULL, 'n'},
+      {"audio", required_argument, NULL, 'a'},
+      {"audio-rate", required_argument, NULL, OPT_AUDIO_RATE},
+      {"stream", no_argument, NULL, 'S'},
+      {"file", required_argument, NULL, 'F'},
+      {"channels", required_argument, NULL, OPT_CHANNELS},
+      {"sys", no_argument, NULL, 'M'},
+      {"interval", required_argument, NULL, OPT_INTERVAL},
+      {"pv", no_argument, NULL, 'P'},
+      {"height", required_argument, NULL, 'H'},
+      {"progress", optional_argument, NULL, OPT_PROGRESS},
+      {"once", no_argument, NULL, OPT_ONCE},
+      {"size", required_argument, NULL, OPT_SIZE},
+      {"plugin", required_argument, NULL, OPT_PLUGIN},
+      {"generator", required_argument, NULL, OPT_GENERATOR},
+      {"formula", required_argument, NULL, OPT_FORMULA},
+      {"shape", required_argument, NULL, OPT_SHAPE},
+      {"wave", required_argument, NULL, OPT_WAVE},
+      {"noise", no_argument, NULL, OPT_NOISE},
+      {"superpose", optional_argument, NULL, OPT_SUPERPOSE},
+      {"physics", optional_argument, NULL, OPT_PHYSICS},
+      {"ripple", optional_argument, NULL, OPT_RIPPLE},
+      {"threads", required_argument, NULL, OPT_THREADS},
+      {"foam", optional_argument, NULL, OPT_FOAM},
+      {"3d", no_argument, NULL, OPT_3D},
+      {"metrics-out", required_argument, NULL, OPT_METRICS_OUT},
+      {"metrics-per-sec", no_argument, NULL, OPT_METRICS_AGGREGATE},
+      {"metrics-listen", required_argument, NULL, OPT_METRICS_LISTEN},
+      {"perf-counters", no_argument, NULL, OPT_PERF_COUNTERS},
+      {"trace", required_argument, NULL, OPT_TRACE},
+      {"realtime", optional_argument, NULL, OPT_REALTIME},
       {"version", no_argument, NULL, 'v'},
       {"help", no_argument, NULL, 'h'},
       {NULL, 0, NULL, 0},
   };
 
   int opt;
-  while ((opt = getopt_long(argc, argv, "s:f:c:g:n:vh", long_opts, NULL)) !=
+  while ((opt = getopt_long(argc, argv, "s:f:c:g:n:a:SF:MPH:vh", long_opts, NULL)) !=
          -1) {
     switch (opt) {
     case 's': {
@@ -480,16 +3738,6 @@ static WaveConfig parse_args(int argc, char **argv) {
       break;
     }
     case 'c':
-      if (!find_palette(optarg)) {
-        fprintf(stderr,
-                "\033[1;31merror:\033[0m unknown palette '%s'\n"
-                "available: ",
-                optarg);
-        for (int i = 0; i < NUM_PALETTES; i++)
-          fprintf(stderr, "%s%s", palettes[i].name,
-                  i < NUM_PALETTES - 1 ? ", " : "\n");
-        exit(EXIT_ERR);
-      }
       cfg.color_name = optarg;
       break;
     case 'g':
@@ -504,6 +3752,168 @@ static WaveConfig parse_args(int argc, char **argv) {
       cfg.num_waves = (int)val;
       break;
     }
+    case 'a':
+      cfg.audio_path = optarg;
+      break;
+    case OPT_AUDIO_RATE: {
+      long val;
+      if (!parse_long(optarg, &val) || val < 1000 || val > 384000)
+        die("invalid audio rate '%s' (must be 1000-384000 Hz)", optarg);
+      cfg.audio_rate = (int)val;
+      break;
+    }
+    case 'S':
+      cfg.stream = true;
+      break;
+    case 'F':
+      cfg.file_path = optarg;
+      break;
+    case 'M':
+      cfg.sys = true;
+      break;
+    case 'P':
+      cfg.pv = true;
+      break;
+    case OPT_PROGRESS:
+      cfg.progress = true;
+      if (optarg) {
+        long val;
+        if (!parse_long(optarg, &val) || val < 0 || val > INT_MAX)
+          die("invalid progress descriptor '%s'", optarg);
+        cfg.progress_fd = (int)val;
+      }
+      break;
+    case OPT_ONCE:
+      cfg.once = true;
+      break;
+    case OPT_SIZE: {
+      char *end = NULL;
+      errno = 0;
+      long w = strtol(optarg, &end, 10);
+      long h = 0;
+      if (errno == 0 && end != optarg && (*end == 'x' || *end == 'X')) {
+        const char *hs = end + 1;
+        h = strtol(hs, &end, 10);
+        if (errno != 0 || end == hs || *end != '\0')
+          h = 0;
+      }
+      // Each side is bounded first so the product cannot overflow
+      if (w < 1 || h < 1 || w > ONCE_MAX_CELLS || h > ONCE_MAX_CELLS ||
+          w * h > ONCE_MAX_CELLS)
+        die("invalid size '%s' (COLSxROWS, at most %d cells)", optarg,
+            ONCE_MAX_CELLS);
+      cfg.size_cols = (int)w;
+      cfg.size_rows = (int)h;
+      break;
+    }
+    case 'H': {
+      long val;
+      if (!parse_long(optarg, &val) || val < 1 || val > MAX_HEIGHT)
+        die("height must be between 1 and %d lines", MAX_HEIGHT);
+      cfg.height = (int)val;
+      break;
+    }
+    case OPT_INTERVAL: {
+      long val;
+      if (!parse_long(optarg, &val) || val < 10 || val > 60000)
+        die("invalid interval '%s' (must be 10-60000 ms)", optarg);
+      cfg.sys_interval = (int)val;
+      break;
+    }
+    case OPT_CHANNELS: {
+      long val;
+      if (!parse_long(optarg, &val) || val < 1 || val > FILE_MAX_CHANNELS)
+        die("channels must be between 1 and %d", FILE_MAX_CHANNELS);
+      cfg.channels = (int)val;
+      break;
+    }
+    case OPT_PLUGIN:
+      plugin_load(optarg);
+      break;
+    case OPT_GENERATOR:
+      cfg.generator = optarg;
+      break;
+    case OPT_FORMULA: {
+      WaveFormula f;
+      char err[128];
+      if (!wave_formula_compile(&f, optarg, err, sizeof(err)))
+        die("invalid formula '%s': %s", optarg, err);
+      cfg.formula = optarg;
+      break;
+    }
+    case OPT_SHAPE:
+      cfg.shape = wave_find_shape(optarg);
+      if (cfg.shape < 0)
+        die("unknown wave shape '%s' (sine, square, triangle, saw, noise)",
+            optarg);
+      break;
+    case OPT_WAVE:
+      if (cfg.num_specs == MAX_WAVE_SPECS)
+        die("at most %d --wave options", MAX_WAVE_SPECS);
+      parse_wave_spec(optarg, &cfg.specs[cfg.num_specs++]);
+      break;
+    case OPT_NOISE:
+      cfg.noise = true;
+      break;
+    case OPT_SUPERPOSE:
+      if (!optarg || strcmp(optarg, "line") == 0)
+        cfg.superpose = WAVE_SUPERPOSE_LINE;
+      else if (strcmp(optarg, "intensity") == 0)
+        cfg.superpose = WAVE_SUPERPOSE_INTENSITY;
+      else
+        die("unknown superpose display '%s' (line, intensity)", optarg);
+      break;
+    case OPT_PHYSICS:
+      cfg.physics = true;
+      if (optarg && (!parse_double(optarg, &cfg.impulse_rate) ||
+                     cfg.impulse_rate < 0.0))
+        die("invalid impulse rate '%s' (must be a number >= 0)", optarg);
+      break;
+    case OPT_RIPPLE:
+      cfg.ripple = true;
+      cfg.impulse_rate = RIPPLE_DEFAULT_RATE;
+      if (optarg && (!parse_double(optarg, &cfg.impulse_rate) ||
+                     cfg.impulse_rate < 0.0))
+        die("invalid drop rate '%s' (must be a number >= 0)", optarg);
+      break;
+    case OPT_3D:
+      cfg.ocean = true;
+      break;
+    case OPT_METRICS_OUT:
+      cfg.metrics_path = optarg;
+      break;
+    case OPT_METRICS_AGGREGATE:
+      cfg.metrics_aggregate = true;
+      break;
+    case OPT_METRICS_LISTEN:
+      cfg.metrics_listen = optarg;
+      break;
+    case OPT_PERF_COUNTERS:
+      cfg.perf_counters = true;
+      break;
+    case OPT_TRACE:
+      cfg.trace_path = optarg;
+      break;
+    case OPT_REALTIME:
+      parse_realtime(optarg, &cfg);
+      break;
+    case OPT_THREADS: {
+      long val;
+      if (!parse_long(optarg, &val) || val < 1 || val > RIPPLE_MAX_THREADS)
+        die("invalid thread count '%s' (must be 1-%d)", optarg,
+            RIPPLE_MAX_THREADS);
+      cfg.threads = (int)val;
+      break;
+    }
+    case OPT_FOAM: {
+      long val = FOAM_DEFAULT_PARTICLES;
+      if (optarg &&
+          (!parse_long(optarg, &val) || val < 1 || val > FOAM_MAX_PARTICLES))
+        die("invalid foam particle count '%s' (must be 1-%d)", optarg,
+            FOAM_MAX_PARTICLES);
+      cfg.foam = (int)val;
+      break;
+    }
     case 'v':
       print_version();
       exit(EXIT_OK);
@@ -515,6 +3925,78 @@ static WaveConfig parse_args(int argc, char **argv) {
       exit(EXIT_ERR);
     }
   }
+  if (optind < argc)
+    cfg.cmd_argv = argv + optind;
+  if (cfg.num_waves < cfg.num_specs)
+    cfg.num_waves = cfg.num_specs;
+  // Checked after the loop so names added by any --plugin resolve
+  if (!wave_find_palette(cfg.color_name))
+    die_unknown("palette", cfg.color_name, wave_palette_name,
+                wave_palette_count());
+  if (cfg.formula && cfg.generator)
+    die("--formula and --generator are mutually exclusive");
+  if (cfg.noise && (cfg.formula || cfg.generator))
+    die("--noise cannot be combined with --formula or --generator");
+  // Every wave is a plain sine across the 3D mesh; only its frequency,
+  // amplitude and speed carry over
+  bool shaped_specs = false;
+  for (int i = 0; i < cfg.num_specs; i++)
+    if (cfg.specs[i].set & (SPEC_SHAPE | SPEC_HARM | SPEC_GLYPH))
+      shaped_specs = true;
+  if (cfg.ocean && (cfg.generator || cfg.shape >= 0 || shaped_specs))
+    die("--3d draws plain sines and cannot be combined with --generator, "
+        "--shape or a --wave shape, harm or glyph");
+  if (!cfg.generator)
+    cfg.generator = "shape";
+  if (!wave_find_generator(cfg.generator))
+    die_unknown("generator", cfg.generator, wave_generator_name,
+                wave_generator_count());
+  if ((cfg.audio_path != NULL) + cfg.stream + (cfg.file_path != NULL) +
+          cfg.sys + cfg.pv + (cfg.cmd_argv != NULL) + cfg.progress +
+          cfg.once + cfg.physics + cfg.ripple >
+      1)
+    die("--audio, --stream, --file, --sys, --pv, --progress, --once, "
+        "--physics, --ripple and a wrapped command are mutually exclusive");
+  if (cfg.physics && (cfg.noise || cfg.formula || cfg.superpose))
+    die("--physics cannot be combined with --noise, --formula or "
+        "--superpose");
+  if (cfg.ripple && (cfg.noise || cfg.formula || cfg.superpose))
+    die("--ripple cannot be combined with --noise, --formula or "
+        "--superpose");
+  // Mouse reports carry screen rows, so the tank takes the whole screen
+  if (cfg.ripple && cfg.height)
+    die("--ripple is full screen and cannot be combined with --height");
+  if (cfg.size_cols && !cfg.once)
+    die("--size only applies to --once");
+  // 3D reshapes the wave set rather than replacing its source, but
+  // draws its own frame
+  if (cfg.ocean &&
+      (cfg.stream || cfg.file_path || cfg.progress || cfg.once ||
+       cfg.physics || cfg.ripple || cfg.noise || cfg.formula ||
+       cfg.superpose || cfg.foam))
+    die("--3d cannot be combined with --stream, --file, --progress, --once, "
+        "--physics, --ripple, --noise, --formula, --superpose or --foam");
+  if (cfg.threads && !cfg.ripple && !cfg.ocean)
+    die("--threads only applies to --ripple and --3d");
+  if (cfg.foam && (cfg.ripple || cfg.once))
+    die("--foam cannot be combined with --ripple or --once");
+  if (cfg.metrics_aggregate && !cfg.metrics_path)
+    die("--metrics-per-sec needs --metrics-out");
+  // Both pace frames by their input rather than by the clock
+  if (cfg.realtime && (cfg.progress || cfg.cmd_argv))
+    die("--realtime cannot be combined with --progress or a wrapped "
+        "command");
+  if ((cfg.metrics_path || cfg.metrics_listen || cfg.perf_counters ||
+       cfg.trace_path || cfg.realtime) &&
+      cfg.once)
+    die("--metrics-out, --metrics-listen, --perf-counters, --trace and "
+        "--realtime cannot be combined with --once");
+  // These modes draw their own series rather than the wave set
+  if (cfg.superpose && (cfg.stream || cfg.file_path || cfg.progress))
+    die("--superpose cannot be combined with --stream, --file or "
+        "--progress");
+  if (cfg.num_waves > MAX_SERIES && (cfg.audio_path || cfg.pv))
+    die("--audio and --pv drive at most %d waves", MAX_SERIES);
   return cfg;
 }
 
@@ -524,11 +4006,15 @@ static WaveConfig parse_args(int argc, char **argv) {
 
 int main(int argc, char **argv) {
   WaveConfig cfg = parse_args(argc, argv);
-  palette_fn colorize = find_palette(cfg.color_name);
-  if (!colorize) {
+  const unsigned char *lut = wave_find_palette(cfg.color_name);
+  if (!lut) {
     die("internal error: palette '%s' not found", cfg.color_name);
   }
 
+  // Prompt/status-line fast path: nothing below this line runs
+  if (cfg.once)
+    return render_once(&cfg, lut);
+
   const int frame_delay = 1000000 / cfg.fps;
 
   // ── Set up signal handlers ─────────────────────────────────────
@@ -547,140 +4033,329 @@ int main(int argc, char **argv) {
   sigaction(SIGTERM, &sa_int, NULL);
 
   // ── Allocate waves ─────────────────────────────────────────────
-  g_waves = xmalloc((size_t)cfg.num_waves * sizeof(Wave));
-  g_phase = xcalloc((size_t)cfg.num_waves, sizeof(double));
-  generate_waves(g_waves, cfg.num_waves, cfg.glyph);
+  // Stream and file modes take their series count from the data
+  if (cfg.stream)
+    cfg.num_waves = MAX_SERIES;
+  if (cfg.file_path) {
+    file_open(&g_file, cfg.file_path, cfg.channels);
+    cfg.num_waves = g_file.num_series;
+    term_raw_input();
+  }
+  if (cfg.physics || cfg.ripple)
+    term_raw_input();
+  if (cfg.sys)
+    cfg.num_waves = sys_start(&g_sys, cfg.sys_interval);
+  if (cfg.pv)
+    g_out_fd = pv_start(&g_pv);
+  if (cfg.progress)
+    g_progress.fd = cfg.progress_fd;
+  // One animation tick per frame, as the frame counter is the clock
+  const WaveOptions wopt = {
+      .num_waves = cfg.num_waves,
+      .speed_mult = cfg.speed_mult,
+      .tick_rate = cfg.fps,
+      .palette = cfg.color_name,
+      .glyph = cfg.glyph,
+      .generator = cfg.generator,
+      .formula = cfg.formula,
+      .noise = cfg.noise,
+      .superpose = cfg.superpose,
+      .physics = cfg.physics,
+      .impulse_rate = cfg.impulse_rate,
+      .ripple = cfg.ripple,
+      .ocean = cfg.ocean,
+      .threads = cfg.threads,
+      .foam = cfg.foam,
+  };
+  g_ctx = wave_ctx_new(&wopt);
+  if (!g_ctx)
+    die_oom("wave context");
+  Wave *waves = wave_ctx_waves(g_ctx);
+  apply_wave_specs(&cfg, waves, cfg.num_waves);
+  if (cfg.stream)
+    stream_start(STDIN_FILENO);
+  if (cfg.audio_path)
+    audio_start(cfg.audio_path, cfg.audio_rate, waves, cfg.num_waves);
 
   // ── Initial terminal state ─────────────────────────────────────
-  int rows = 0, cols = 0;
-  term_size(&rows, &cols);
+  // Frames cover `rows` lines of a `term_rows` terminal. A wrapped
+  // command owns the screen above a strip starting at origin_row
+  // (1-based); --height alone draws inline below the cursor; otherwise
+  // the whole screen is used.
+  int term_rows = 0, rows = 0, cols = 0, origin_row = 0;
+  const bool inline_mode = cfg.height > 0 && !cfg.cmd_argv;
+  term_size(&term_rows, &cols);
+  rows = region_rows(&cfg, term_rows);
+  if (cfg.cmd_argv) {
+    origin_row = term_rows - rows + 1;
+    wrap_start(&g_wrap, cfg.cmd_argv, term_rows - rows, cols);
+  }
 
-  size_t cells = (size_t)rows * (size_t)cols;
-  g_fb = xmalloc(cells * sizeof(int));
-  g_fbval = xmalloc(cells * sizeof(double));
+  // File mode keeps a min and a max array per series,
+  // and progress mode a surface plus a floor array
+  const size_t ys_arrays =
+      cfg.file_path ? 2 * (size_t)cfg.num_waves : (cfg.progress ? 2 : 1);
 
-  size_t buf_cap = cells * MAX_BYTES_PER_CELL + FRAME_BUF_PADDING;
+  size_t buf_cap = wave_frame_capacity(rows, cols);
   g_frame_buf = xmalloc(buf_cap);
 
-  // Hide cursor, clear screen
-  {
+  // Hide cursor, clear screen — or, inline, scroll `rows` blank lines
+  // into view and remember where they start
+  if (inline_mode) {
+    size_t n = 0;
+    n += (size_t)snprintf(g_frame_buf + n, buf_cap - n, "\033[?25l");
+    for (int r = 1; r < rows; r++)
+      g_frame_buf[n++] = '\n';
+    if (rows > 1)
+      n += (size_t)snprintf(g_frame_buf + n, buf_cap - n, "\033[%dA",
+                            rows - 1);
+    n += (size_t)snprintf(g_frame_buf + n, buf_cap - n, "\r\0337");
+    (void)write(g_out_fd, g_frame_buf, n);
+  } else if (!cfg.cmd_argv) {
     const char init[] = "\033[?25l\033[2J";
-    (void)write(STDOUT_FILENO, init, sizeof(init) - 1);
+    (void)write(g_out_fd, init, sizeof(init) - 1);
+  }
+  if (cfg.ripple && g_tio_saved)
+    term_mouse_on();
+
+  if (cfg.metrics_path)
+    metrics_start(&g_metrics, cfg.metrics_path, cfg.metrics_aggregate);
+  if (cfg.metrics_listen)
+    prom_start(&g_prom, cfg.metrics_listen, cfg.fps, frame_delay);
+  if (cfg.perf_counters)
+    perf_start(&g_perf);
+  if (cfg.trace_path)
+    trace_start(&g_trace, cfg.trace_path, mono_us());
+  // Stages are only timed when something consumes the timings
+  const bool timed = g_metrics.running || g_prom.fd >= 0 ||
+                     g_perf.num_open > 0 || g_trace.fd >= 0;
+  const uint64_t epoch = timed ? mono_us() : 0;
+  if (cfg.realtime) {
+    realtime_grow(g_ctx, rows, cols, 0.0, ys_arrays);
+    realtime_start(&g_rt, &cfg);
+    realtime_prefault(&g_rt, g_frame_buf, buf_cap);
   }
 
-  unsigned int rng_state = 12345u;
   int frame = 0;
 
   while (!g_quit) {
+    FrameRecord rec = {.frame = (uint64_t)frame};
+
     // ── Handle resize ──────────────────────────────────────────
     if (g_resized) {
       g_resized = 0;
-      term_size(&rows, &cols);
-      cells = (size_t)rows * (size_t)cols;
-      buf_cap = cells * MAX_BYTES_PER_CELL + FRAME_BUF_PADDING;
-
-      g_fb = xrealloc(g_fb, cells * sizeof(int));
-      g_fbval = xrealloc(g_fbval, cells * sizeof(double));
+      rec.resized = true;
+      if (g_trace.fd >= 0) {
+        trace_signal(&g_trace, TRACE_SIGWINCH, &g_winch_us);
+        trace_event(&g_trace, TRACE_RESIZE, 'B', mono_us());
+      }
+      term_size(&term_rows, &cols);
+      rows = region_rows(&cfg, term_rows);
+      if (cfg.cmd_argv) {
+        origin_row = term_rows - rows + 1;
+        wrap_resize(&g_wrap, term_rows - rows, cols);
+      }
+      buf_cap = wave_frame_capacity(rows, cols);
       g_frame_buf = xrealloc(g_frame_buf, buf_cap);
+      if (cfg.realtime) {
+        realtime_grow(g_ctx, rows, cols, (double)frame / cfg.fps,
+                      ys_arrays);
+        realtime_prefault(&g_rt, g_frame_buf, buf_cap);
+      }
 
       // Clear screen on resize to avoid visual artifacts
-      const char cls[] = "\033[2J";
-      (void)write(STDOUT_FILENO, cls, sizeof(cls) - 1);
+      if (!cfg.cmd_argv && !inline_mode) {
+        const char cls[] = "\033[2J";
+        (void)write(g_out_fd, cls, sizeof(cls) - 1);
+      }
+      if (g_trace.fd >= 0)
+        trace_event(&g_trace, TRACE_RESIZE, 'E', mono_us());
     }
 
-    // ── Clear cell buffer ──────────────────────────────────────
-    memset(g_fb, 0xFF, cells * sizeof(int)); // -1 fill
+    // ── Clear cell grid, advance phases ────────────────────────
+    uint64_t mark = timed ? stage_begin((uint64_t)frame) : 0;
+    rec.start_us = mark - epoch;
+    WaveGrid *grid = wave_ctx_begin(g_ctx, rows, cols, (double)frame / cfg.fps);
+    double *ys = grid ? wave_ctx_scratch(g_ctx, ys_arrays) : NULL;
+    if (!ys)
+      die_oom("frame grid");
+    if (timed)
+      stage_end(&rec, STAGE_CLEAR, &mark);
+
+    // ── Step the physics string or ripple tank ─────────────────
+    wave_ctx_simulate(g_ctx);
+    if (timed)
+      stage_end(&rec, STAGE_SIMULATE, &mark);
 
     const int mid_y = rows / 2;
 
+    // ── Drive waves from live sources ──────────────────────────
+    if (cfg.audio_path && !audio_update(waves, cfg.num_waves))
+      break;
+    if (cfg.sys)
+      sys_update(&g_sys, waves, cfg.num_waves);
+    if (cfg.pv && !pv_update(&g_pv, waves, cfg.num_waves))
+      g_quit = 1;
+
     // ── Plot waves ─────────────────────────────────────────────
-    for (int w = 0; w < cfg.num_waves; w++) {
-      for (int x = 0; x < cols; x++) {
-        double y_raw =
-            g_waves[w].amp * mid_y * sin(g_waves[w].freq * x + g_phase[w]);
-        int y = mid_y + (int)y_raw;
-        if (y >= 0 && y < rows) {
-          size_t idx = (size_t)y * (size_t)cols + (size_t)x;
-          g_fb[idx] = w;
-          g_fbval[idx] = (double)x / cols + (double)frame / FRAME_COLOR_DIVISOR;
-        }
+    const double color_base = wave_ctx_color_base(g_ctx);
+    if (cfg.stream) {
+      stream_poll(&g_stream);
+      double lo, hi;
+      stream_range(&g_stream, cols, &lo, &hi);
+      for (int s = 0; s < g_stream.num_series; s++) {
+        stream_column(&g_stream, s, cols, lo, hi, ys);
+        wave_plot_column(grid, s, ys, mid_y, (rows - 1) / 2.0, color_base);
       }
-      g_phase[w] += g_waves[w].phase_spd * cfg.speed_mult;
+    } else if (cfg.file_path) {
+      for (int key; (key = term_read_key()) != KEY_NONE;)
+        if (!file_handle_key(&g_file, key, cols))
+          g_quit = 1;
+      file_clamp_view(&g_file, cols);
+      double *lo = ys;
+      double *hi = ys + (size_t)g_file.num_series * (size_t)cols;
+      file_columns(&g_file, cols, lo, hi);
+      for (int s = 0; s < g_file.num_series; s++) {
+        size_t off = (size_t)s * (size_t)cols;
+        wave_plot_span(grid, s, lo + off, hi + off, mid_y, (rows - 1) / 2.0,
+                       color_base);
+      }
+    } else if (cfg.progress) {
+      // Waves ride on the level; the front wave is filled to the floor
+      const int level = progress_level(&g_progress, rows);
+      const double swell = rows > 12 ? rows / 12.0 : 1.0;
+      double *floor_ys = ys + cols;
+      for (int x = 0; x < cols; x++)
+        floor_ys[x] = (double)rows / swell;
+      for (int w = cfg.num_waves - 1; w >= 0; w--) {
+        wave_ctx_wave_columns(g_ctx, w, ys);
+        if (w == 0)
+          wave_plot_span(grid, w, ys, floor_ys, level, swell,
+                         color_base + g_progress.shown);
+        else
+          wave_plot_column(grid, w, ys, level, waves[w].amp * swell,
+                           color_base + g_progress.shown);
+      }
+    } else {
+      if (cfg.physics)
+        for (int key; (key = term_read_key()) != KEY_NONE;)
+          if (!physics_handle_key(key))
+            g_quit = 1;
+      if (cfg.ripple)
+        for (int key; (key = term_read_key()) != KEY_NONE;)
+          if (!ripple_handle_key(key, rows, cols))
+            g_quit = 1;
+      wave_ctx_plot(g_ctx);
     }
+    wave_ctx_foam(g_ctx);
+    if (timed)
+      stage_end(&rec, STAGE_PLOT, &mark);
 
     // ── Render into frame buffer ───────────────────────────────
     size_t pos = 0;
 
-    // Cursor home
-    memcpy(g_frame_buf + pos, "\033[H", 3);
-    pos += 3;
-
-    for (int r = 0; r < rows; r++) {
-      for (int c = 0; c < cols; c++) {
-        // Safety: ensure we never overflow the buffer
-        if (pos + MAX_BYTES_PER_CELL >= buf_cap)
-          goto flush;
-
-        size_t idx = (size_t)r * (size_t)cols + (size_t)c;
-        if (g_fb[idx] >= 0) {
-          int w = g_fb[idx];
-          double t = fmod(g_fbval[idx] + w * WAVE_COLOR_OFFSET, 1.0);
-          if (t < 0.0)
-            t += 1.0;
-          int color = colorize(t);
-
-          // Write fg color escape via snprintf for safety
-          int written = snprintf(g_frame_buf + pos, buf_cap - pos,
-                                 "\033[38;5;%dm", color);
-          if (written > 0)
-            pos += (size_t)written;
-
-          // Write glyph
-          const char *gl = g_waves[w].glyph;
-          size_t gl_len = strlen(gl);
-          if (pos + gl_len + 4 < buf_cap) {
-            memcpy(g_frame_buf + pos, gl, gl_len);
-            pos += gl_len;
-          }
-
-          // Reset attributes
-          if (pos + 4 < buf_cap) {
-            memcpy(g_frame_buf + pos, "\033[0m", 4);
-            pos += 4;
-          }
-        } else {
-          // Subtle starfield background — fast xorshift RNG
-          rng_state ^= rng_state << 13;
-          rng_state ^= rng_state >> 17;
-          rng_state ^= rng_state << 5;
-
-          if ((rng_state % STARFIELD_DENSITY) == 0) {
-            int gray = STARFIELD_GRAY_BASE +
-                       (int)((rng_state >> 8) % STARFIELD_GRAY_RANGE);
-            int written = snprintf(g_frame_buf + pos, buf_cap - pos,
-                                   "\033[38;5;%dm.\033[0m", gray);
-            if (written > 0)
-              pos += (size_t)written;
-          } else {
-            g_frame_buf[pos++] = ' ';
-          }
-        }
-      }
-      if (r < rows - 1) {
-        g_frame_buf[pos++] = '\n';
-      }
+    // Cursor home, save the wrapped command's cursor, or return to the
+    // top of the inline region
+    if (origin_row) {
+      memcpy(g_frame_buf + pos, "\0337", 2);
+      pos += 2;
+    } else if (inline_mode) {
+      memcpy(g_frame_buf + pos, "\0338", 2);
+      pos += 2;
+    } else {
+      memcpy(g_frame_buf + pos, "\033[H", 3);
+      pos += 3;
+    }
+
+    pos += wave_ctx_encode(g_ctx, origin_row, g_frame_buf + pos, buf_cap - pos);
+
+    // ── Status text over the bottom row of the region ──────────
+    if ((cfg.pv || cfg.progress) && pos + WAVE_FRAME_PADDING / 2 < buf_cap) {
+      pos += region_cursor(g_frame_buf + pos, buf_cap - pos, origin_row,
+                           inline_mode, rows - 1);
+      if (cfg.pv)
+        pos += pv_status(&g_pv, cfg.num_waves, g_frame_buf + pos,
+                         buf_cap - pos);
+      else
+        pos += progress_status(&g_progress, g_frame_buf + pos, buf_cap - pos);
+    }
+
+    if (cfg.perf_counters && pos + WAVE_FRAME_PADDING / 2 < buf_cap) {
+      pos += region_cursor(g_frame_buf + pos, buf_cap - pos, origin_row,
+                           inline_mode, 0);
+      pos += perf_status(&g_perf, cols, g_frame_buf + pos, buf_cap - pos);
+    }
+
+    if (origin_row && pos + 2 < buf_cap) {
+      memcpy(g_frame_buf + pos, "\0338", 2);
+      pos += 2;
     }
 
-  flush:
+    if (timed)
+      stage_end(&rec, STAGE_ENCODE, &mark);
+
     // ── Single write for entire frame ──────────────────────────
-    (void)write(STDOUT_FILENO, g_frame_buf, pos);
+    ssize_t written = 0;
+    if (!cfg.cmd_argv || wrap_can_draw(&g_wrap))
+      written = write(g_out_fd, g_frame_buf, pos);
+
+    if (timed) {
+      stage_end(&rec, STAGE_WRITE, &mark);
+      uint64_t work_us = 0;
+      for (int s = 0; s < STAGE_COUNT; s++)
+        work_us += rec.stage_us[s];
+      rec.bytes = written > 0 ? (uint32_t)written : 0;
+      rec.missed = work_us > (uint64_t)frame_delay;
+      rec.fps = cfg.fps;
+      rec.waves = cfg.num_waves;
+      rec.rows = rows;
+      rec.cols = cols;
+      if (g_metrics.running)
+        metrics_push(&g_metrics, &rec);
+      if (g_prom.fd >= 0) {
+        prom_record(&g_prom, &rec);
+        prom_serve(&g_prom, rec.start_us);
+      }
+      perf_frame(&g_perf, (uint64_t)rows * (uint64_t)cols, rec.start_us);
+    }
 
     frame++;
-    usleep((unsigned)frame_delay);
+    if (cfg.cmd_argv) {
+      if (!wrap_pump(&g_wrap, frame_delay))
+        break;
+    } else if (cfg.progress) {
+      if (!progress_wait(&g_progress, frame_delay))
+        break;
+    } else if (cfg.realtime) {
+      realtime_wait(&g_rt, frame_delay);
+    } else {
+      usleep((unsigned)frame_delay);
+    }
   }
 
   // ── Graceful cleanup after signal ──────────────────────────────
+  metrics_stop(&g_metrics);
+  prom_stop(&g_prom);
+  if (g_trace.fd >= 0 && g_quit_signal)
+    trace_signal(&g_trace,
+                 g_quit_signal == SIGTERM ? TRACE_SIGTERM : TRACE_SIGINT,
+                 &g_quit_us);
+  trace_stop(&g_trace);
+  int status = cfg.pv && g_pv.failed ? EXIT_ERR : EXIT_OK;
+  if (cfg.cmd_argv)
+    status = wrap_finish(&g_wrap, origin_row);
+  if (inline_mode) {
+    // Leave the last frame in place and continue below it
+    char seq[32];
+    int n = rows > 1 ? snprintf(seq, sizeof(seq), "\0338\033[%dB", rows - 1)
+                     : snprintf(seq, sizeof(seq), "\0338");
+    (void)write(g_out_fd, seq, (size_t)n);
+  }
   cleanup_terminal();
+  if (cfg.perf_counters)
+    perf_stop(&g_perf);
+  if (cfg.realtime)
+    realtime_report(&g_rt);
   cleanup_resources();
-  return EXIT_OK;
+  return status;
 }